@@ -2,7 +2,7 @@
 
 pushd w:\renderer
 
-set CommonCompilerFlags= -DLL -MTd -nologo -Gm- -GR- -EHa- /EHsc -Od -Oi -WX -W4 -wd4201 -wd4100 -wd4189 -wd4505 -wd4706 -DBUILD_INTERNAL=1 -DBUILD_SLOW=1 -DBUILD_WIN32=1 -FC -Z7 -Fm
+set CommonCompilerFlags= -DLL -MTd -nologo -Gm- -GR- -EHa- /EHsc -Od -Oi -WX -W4 -wd4201 -wd4100 -wd4189 -wd4505 -wd4706 -DBUILD_INTERNAL=1 -DBUILD_SLOW=1 -DBUILD_WIN32=1 -D_CRT_SECURE_NO_WARNINGS -FC -Z7 -Fm
 set CommonLinkerFlags= -incremental:no -opt:ref winmm.lib user32.lib gdi32.lib
 
 if not defined DevEnvDir (
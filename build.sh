@@ -0,0 +1,17 @@
+#!/bin/bash
+
+set -e
+
+CommonCompilerFlags="-std=c++11 -O2 -g -march=native -ffp-contract=off -Wall -Wno-unused-parameter -Wno-unused-variable -Wno-unused-function -Wno-write-strings -DBUILD_INTERNAL=1 -DBUILD_SLOW=1 -DBUILD_LINUX=1"
+CommonLinkerFlags="-lm"
+
+cd "$(dirname "$0")"
+RendererPath="$(pwd)"
+
+mkdir -p ../build
+pushd ../build > /dev/null
+
+g++ $CommonCompilerFlags "$RendererPath/src/linux_renderer.cpp" -o linux_renderer $CommonLinkerFlags
+g++ $CommonCompilerFlags "$RendererPath/src/linux_benchmark.cpp" -o linux_benchmark $CommonLinkerFlags
+
+popd > /dev/null
@@ -0,0 +1,872 @@
+#include "linux_platform.cpp"
+#include "linux_benchmark.h"
+
+// Above this line are the platform service functions
+#include "renderer.cpp"
+
+// Benchmarks of the hot paths on their own: the triangle rasterizers
+// across sizes and aspect ratios, DebugLine across slopes and clipped,
+// model loading from text and from the cache, whole frames at several
+// resolutions, in every shading mode and as a wireframe, and the shadow
+// map.
+//
+// Every benchmark is run in samples of enough iterations to take about
+// kSampleNs, and reports the median time per iteration and the median
+// absolute deviation (MAD) as its noise. Against a baseline, which is the
+// JSON of an earlier run, a change of the median only counts when it is
+// beyond kNoiseFactor times the relative noise of both runs, and never
+// below kMinThreshold. The program exits with 1 when anything got slower.
+
+const u64 kSampleNs = 20 * 1000 * 1000;
+const u64 kBenchmarkNs = 500 * 1000 * 1000;  // samples of one benchmark
+const int kMinSamples = 5;
+const int kMaxSamples = 31;
+const r64 kNoiseFactor = 3.0;
+const r64 kMinThreshold = 0.05;
+
+const int kMaxBenchmarks = 128;
+const int kTextureSize = 1024;  // same as the model's diffuse texture
+// Loads read the texture too, a small one leaves the time to the model
+const int kLoadTextureSize = 8;
+
+#define BENCHMARK_PROC(name) void name(void *data, int iterations)
+typedef BENCHMARK_PROC(BenchmarkProc);
+
+internal int CompareReal64(const void *a, const void *b) {
+  r64 x = *(const r64 *)a;
+  r64 y = *(const r64 *)b;
+  return (x > y) - (x < y);
+}
+
+// Sorts the values
+internal r64 GetMedian(r64 *values, int count) {
+  qsort(values, count, sizeof(r64), CompareReal64);
+  r64 result = (count % 2) ? values[count / 2]
+                           : (values[count / 2 - 1] + values[count / 2]) / 2;
+  return result;
+}
+
+// Median and MAD of the baseline run of the benchmark, the results are
+// written one per line
+internal bool32 FindBaseline(char *baseline, const char *name, r64 *median,
+                             r64 *mad) {
+  if (!baseline) return false;
+
+  char key[128];
+  snprintf(key, sizeof(key), "\"name\": \"%s\"", name);
+  char *line = strstr(baseline, key);
+  if (!line) return false;
+  char *line_end = strchr(line, '\n');
+
+  const char *kMedianKey = "\"median_ns\": ";
+  const char *kMadKey = "\"mad_ns\": ";
+  char *median_at = strstr(line, kMedianKey);
+  char *mad_at = strstr(line, kMadKey);
+  if (!median_at || !mad_at ||
+      (line_end && (median_at > line_end || mad_at > line_end))) {
+    return false;
+  }
+  *median = atof(median_at + strlen(kMedianKey));
+  *mad = atof(mad_at + strlen(kMadKey));
+  return *median > 0;
+}
+
+internal void CompareWithBaseline(BenchmarkState *state,
+                                  BenchmarkResult *result) {
+  r64 baseline_mad;
+  if (!FindBaseline(state->baseline, result->name,
+                    &result->baseline_median_ns, &baseline_mad)) {
+    result->verdict = Verdict_New;
+    return;
+  }
+
+  r64 noise = baseline_mad / result->baseline_median_ns +
+              result->mad_ns / result->median_ns;
+  result->threshold = kNoiseFactor * noise;
+  if (result->threshold < kMinThreshold) result->threshold = kMinThreshold;
+  result->change = result->median_ns / result->baseline_median_ns - 1.0;
+  if (result->change > result->threshold) {
+    result->verdict = Verdict_Slower;
+  } else if (result->change < -result->threshold) {
+    result->verdict = Verdict_Faster;
+  } else {
+    result->verdict = Verdict_Unchanged;
+  }
+}
+
+inline bool32 IsBenchmarkSelected(BenchmarkState *state, const char *name) {
+  bool32 result =
+      !state->options.filter || strstr(name, state->options.filter);
+  return result;
+}
+
+// Returns 0 if the benchmark is filtered out
+internal BenchmarkResult *AddBenchmark(BenchmarkState *state,
+                                       const char *name) {
+  if (!IsBenchmarkSelected(state, name)) return 0;
+  if (state->result_count == state->max_result_count) return 0;
+
+  BenchmarkResult *result = &state->results[state->result_count++];
+  *result = {};
+  snprintf(result->name, sizeof(result->name), "%s", name);
+  return result;
+}
+
+internal void SkipBenchmark(BenchmarkState *state, const char *name,
+                            const char *reason) {
+  BenchmarkResult *result = AddBenchmark(state, name);
+  if (result) result->skipped = reason;
+}
+
+// items are the work of one iteration, in item_name
+internal BenchmarkResult *RunBenchmark(BenchmarkState *state,
+                                       const char *name, BenchmarkProc *proc,
+                                       void *data, r64 items,
+                                       const char *item_name) {
+  BenchmarkResult *result = AddBenchmark(state, name);
+  if (!result) return 0;
+
+  // The first run warms up and sizes the samples
+  u64 start = PlatformGetWallClock();
+  proc(data, 1);
+  u64 once_ns = PlatformGetWallClock() - start;
+  if (once_ns == 0) once_ns = 1;
+  u64 iterations = kSampleNs / once_ns;
+  if (iterations == 0) iterations = 1;
+  if (iterations > INT_MAX) iterations = INT_MAX;
+  u64 samples = kBenchmarkNs / (iterations * once_ns);
+  if (samples > (u64)kMaxSamples) samples = kMaxSamples;
+  result->iterations = (int)iterations;
+  result->samples = Max((int)samples, kMinSamples);
+
+  r64 sample_ns[kMaxSamples];
+  for (int i = 0; i < result->samples; ++i) {
+    start = PlatformGetWallClock();
+    proc(data, result->iterations);
+    sample_ns[i] =
+        (r64)(PlatformGetWallClock() - start) / result->iterations;
+  }
+
+  result->median_ns = GetMedian(sample_ns, result->samples);
+  result->min_ns = sample_ns[0];
+  for (int i = 0; i < result->samples; ++i) {
+    sample_ns[i] = fabs(sample_ns[i] - result->median_ns);
+  }
+  result->mad_ns = GetMedian(sample_ns, result->samples);
+  result->items = items;
+  result->item_name = item_name;
+
+  CompareWithBaseline(state, result);
+  return result;
+}
+
+//
+// Triangles and lines
+//
+
+enum TrianglePath {
+  TrianglePath_Scanline,
+  TrianglePath_HalfSpace,
+  TrianglePath_DepthOnly,  // half-space, RasterPass_DepthOnly
+
+  TrianglePath_Count,
+};
+
+global const char *g_triangle_path_names[] = {"scanline", "halfspace",
+                                              "depth"};
+
+struct TriangleBenchmark {
+  GameOffscreenBuffer *buffer;
+  Texture *texture;
+  int width;  // of the right angle sides
+  int height;
+  TrianglePath path;
+};
+
+// Every triangle is drawn in front of the last one, so that all of them
+// pass the depth test. Reset with every clear
+global int g_benchmark_z;
+
+internal void ClearBenchmarkBuffer(GameOffscreenBuffer *buffer, int width,
+                                   int height) {
+  ResizeBuffer(buffer, width, height);
+  ClearBuffer(buffer, 0);
+  Rect2i screen = {0, 0, width - 1, height - 1};
+  PrepareDepthTiles(buffer, screen);
+  g_benchmark_z = 0;
+}
+
+// Right triangles in the middle of the buffer, textured once over
+internal BENCHMARK_PROC(DrawTriangles) {
+  TriangleBenchmark *bench = (TriangleBenchmark *)data;
+  GameOffscreenBuffer *buffer = bench->buffer;
+  int x0 = (buffer->width - bench->width) / 2;
+  int y0 = (buffer->height - bench->height) / 2;
+
+  AssembledFace face = {};
+  face.p[0] = {x0, y0, 0};
+  face.p[1] = {x0 + bench->width, y0, 0};
+  face.p[2] = {x0, y0 + bench->height, 0};
+  face.uv[0] = {0, 0};
+  face.uv[1] = {bench->texture->width - 1, 0};
+  face.uv[2] = {0, bench->texture->height - 1};
+  for (int i = 0; i < 3; ++i) {
+    face.inv_w[i] = 1.0f;
+    face.vertex_intensity[i] = 1.0f;
+  }
+  face.intensity = 1.0f;
+
+  PipelineState state = {};
+  state.flags = RasterState_DepthTest | RasterState_DepthWrite |
+                RasterState_Textured;
+  state.color = 0x00FFFFFF;
+  state.alpha = 1.0f;
+  state.texture = bench->texture;
+
+  Rect2i screen = {0, 0, buffer->width - 1, buffer->height - 1};
+  for (int i = 0; i < iterations; ++i) {
+    int z = ++g_benchmark_z;
+    face.p[0].z = face.p[1].z = face.p[2].z = z;
+    if (bench->path == TrianglePath_HalfSpace) {
+      TriangleHalfSpace(&face, &state, buffer);
+    } else if (bench->path == TrianglePath_DepthOnly) {
+      HalfSpaceTriangle tri;
+      if (SetupHalfSpaceTriangle(&tri, &face, &state, buffer->width,
+                                 buffer->height)) {
+        RasterizeHalfSpaceTriangle(&tri, buffer, screen,
+                                   RasterPass_DepthOnly);
+      }
+    } else {
+      Triangle(face.p, face.uv, face.intensity, bench->texture, buffer);
+    }
+  }
+}
+
+struct LineBenchmark {
+  GameOffscreenBuffer *buffer;
+  int dx;
+  int dy;
+};
+
+// Lines through the middle of the buffer
+internal BENCHMARK_PROC(DrawLines) {
+  LineBenchmark *bench = (LineBenchmark *)data;
+  GameOffscreenBuffer *buffer = bench->buffer;
+  int x0 = (buffer->width - bench->dx) / 2;
+  int y0 = (buffer->height - bench->dy) / 2;
+  for (int i = 0; i < iterations; ++i) {
+    DebugLine(buffer, x0, y0, x0 + bench->dx, y0 + bench->dy, 0x00FFFFFF);
+  }
+}
+
+internal void BenchmarkTriangles(BenchmarkState *state,
+                                 GameOffscreenBuffer *buffer,
+                                 Texture *texture) {
+  // Triangle size as the side of a square of twice its area
+  int sizes[] = {4, 16, 64, 256};
+  int aspects[] = {1, 4, 16};  // width over height
+
+  for (int path = 0; path < TrianglePath_Count; ++path) {
+    for (int s = 0; s < (int)COUNT_OF(sizes); ++s) {
+      for (int a = 0; a < (int)COUNT_OF(aspects); ++a) {
+        r32 stretch = SquareRoot((r32)aspects[a]);
+        TriangleBenchmark bench = {};
+        bench.buffer = buffer;
+        bench.texture = texture;
+        bench.width = (int)(sizes[s] * stretch + 0.5f);
+        bench.height = Max((int)(sizes[s] / stretch + 0.5f), 1);
+        bench.path = (TrianglePath)path;
+
+        char name[64];
+        snprintf(name, sizeof(name), "triangle/%s/%dx%d",
+                 g_triangle_path_names[path], bench.width, bench.height);
+        ClearBenchmarkBuffer(buffer, buffer->max_height,
+                             buffer->max_height);
+        RunBenchmark(state, name, DrawTriangles, &bench,
+                     0.5 * bench.width * bench.height, "pixels");
+      }
+    }
+  }
+}
+
+internal void BenchmarkLines(BenchmarkState *state,
+                             GameOffscreenBuffer *buffer) {
+  const int kLength = 512;
+  for (int degrees = 0; degrees <= 90; degrees += 15) {
+    r32 radians = degrees * 3.14159265f / 180.0f;
+    LineBenchmark bench = {};
+    bench.buffer = buffer;
+    bench.dx = (int)(kLength * cosf(radians) + 0.5f);
+    bench.dy = (int)(kLength * sinf(radians) + 0.5f);
+
+    char name[64];
+    snprintf(name, sizeof(name), "line/%d_degrees", degrees);
+    ClearBenchmarkBuffer(buffer, buffer->max_height, buffer->max_height);
+    RunBenchmark(state, name, DrawLines, &bench,
+                 Max(bench.dx, bench.dy) + 1, "pixels");
+  }
+
+  // Long and flat enough that only the width of the buffer is visible
+  LineBenchmark bench = {};
+  bench.buffer = buffer;
+  bench.dx = 100000;
+  bench.dy = 20000;
+  ClearBenchmarkBuffer(buffer, buffer->max_height, buffer->max_height);
+  RunBenchmark(state, "line/clipped", DrawLines, &bench, buffer->width,
+               "pixels");
+}
+
+//
+// Loading
+//
+
+struct LoadBenchmark {
+  const char *filename;
+  const char *texture_filename;
+  char cache_filename[512];
+  bool32 from_text;  // drops the cache before every load
+  bool32 failed;
+};
+
+internal BENCHMARK_PROC(LoadModels) {
+  LoadBenchmark *bench = (LoadBenchmark *)data;
+  for (int i = 0; i < iterations; ++i) {
+    if (bench->from_text) unlink(bench->cache_filename);
+    LoadModelFromFile(&g_model, &g_transient_arena, bench->filename,
+                      bench->texture_filename, FaceOrder_File);
+    if (!g_model.is_loaded) bench->failed = true;
+  }
+}
+
+// Times the load from text, which includes writing the cache, and the
+// load from the cache that leaves behind
+internal void BenchmarkLoad(BenchmarkState *state, const char *label,
+                            const char *filename,
+                            const char *texture_filename) {
+  LoadBenchmark bench = {};
+  bench.filename = filename;
+  bench.texture_filename = texture_filename;
+  snprintf(bench.cache_filename, sizeof(bench.cache_filename), "%s.cache",
+           filename);
+
+  for (int from_text = 1; from_text >= 0; --from_text) {
+    char name[64];
+    snprintf(name, sizeof(name), "load/%s/%s", label,
+             from_text ? "text" : "cache");
+    bench.from_text = from_text;
+    bench.failed = false;
+
+    // Without a cache, the warm up load writes one
+    BenchmarkResult *result =
+        RunBenchmark(state, name, LoadModels, &bench, 0, "faces");
+    if (!result) continue;
+    result->items = g_model.face_count;
+    if (bench.failed) {
+      *result = {};
+      snprintf(result->name, sizeof(result->name), "%s", name);
+      result->skipped = "the model didn't load";
+    }
+  }
+}
+
+// Wavy grid of n x n quads facing the camera, 2 n^2 faces. Returns false
+// if it couldn't be written
+internal bool32 WriteGridModel(const char *filename, int n) {
+  FILE *file = fopen(filename, "wb");
+  if (!file) return false;
+
+  for (int y = 0; y <= n; ++y) {
+    for (int x = 0; x <= n; ++x) {
+      r32 u = (r32)x / n;
+      r32 v = (r32)y / n;
+      r32 z = 0.1f * sinf(u * 20.0f) * cosf(v * 20.0f);
+      fprintf(file, "v %.6f %.6f %.6f\n", 2 * u - 1, 2 * v - 1, z);
+    }
+  }
+  for (int y = 0; y <= n; ++y) {
+    for (int x = 0; x <= n; ++x) {
+      fprintf(file, "vt %.6f %.6f 0.000\n", (r32)x / n, (r32)y / n);
+    }
+  }
+  for (int y = 0; y <= n; ++y) {
+    for (int x = 0; x <= n; ++x) {
+      fprintf(file, "vn 0.000 0.000 1.000\n");
+    }
+  }
+  for (int y = 0; y < n; ++y) {
+    for (int x = 0; x < n; ++x) {
+      int a = y * (n + 1) + x + 1;
+      int b = a + 1;
+      int c = a + n + 1;
+      int d = c + 1;
+      fprintf(file, "f %d/%d/%d %d/%d/%d %d/%d/%d\n", a, a, a, b, b, b, d,
+              d, d);
+      fprintf(file, "f %d/%d/%d %d/%d/%d %d/%d/%d\n", a, a, a, d, d, d, c,
+              c, c);
+    }
+  }
+
+  bool32 result = !ferror(file);
+  if (fclose(file) != 0) result = false;
+  return result;
+}
+
+// Rough upper bound of what loading the grid takes from the model and the
+// transient arena
+internal void EstimateGridLoad(int n, u64 *model_size, u64 *text_size) {
+  u64 vertex_count = (u64)(n + 1) * (n + 1);
+  u64 face_count = 2ull * n * n;
+  int digits = 1;
+  for (u64 i = vertex_count; i >= 10; i /= 10) digits++;
+
+  *model_size = face_count * (sizeof(Face) + sizeof(v3) + sizeof(Meshlet) +
+                              2 * sizeof(Edge)) +
+                vertex_count * (2 * sizeof(v3) + sizeof(v2));
+  *text_size = vertex_count * 90 + face_count * (9 * digits + 10);
+}
+
+internal void BenchmarkSyntheticLoads(BenchmarkState *state,
+                                      const char *texture_filename) {
+  int face_counts[] = {1000, 10000, 100000, 1000000, 10000000};
+  const char *labels[] = {"grid_1k", "grid_10k", "grid_100k", "grid_1m",
+                          "grid_10m"};
+
+  for (int i = 0; i < (int)COUNT_OF(face_counts); ++i) {
+    char text_name[64];
+    char cache_name[64];
+    snprintf(text_name, sizeof(text_name), "load/%s/text", labels[i]);
+    snprintf(cache_name, sizeof(cache_name), "load/%s/cache", labels[i]);
+    if (!IsBenchmarkSelected(state, text_name) &&
+        !IsBenchmarkSelected(state, cache_name)) {
+      continue;  // don't write the model for nothing
+    }
+
+    int n = (int)(sqrtf(face_counts[i] / 2.0f) + 0.5f);
+    u64 model_size, text_size;
+    EstimateGridLoad(n, &model_size, &text_size);
+    if (model_size > g_model.arena.size ||
+        text_size > g_transient_arena.size / 2) {
+      SkipBenchmark(state, text_name, "larger than the arenas");
+      SkipBenchmark(state, cache_name, "larger than the arenas");
+      continue;
+    }
+
+    char filename[512];
+    snprintf(filename, sizeof(filename), "%s/renderer_benchmark_%s.model",
+             state->options.temp_path, labels[i]);
+    char cache_filename[sizeof(filename) + 8];
+    snprintf(cache_filename, sizeof(cache_filename), "%s.cache", filename);
+
+    if (WriteGridModel(filename, n)) {
+      BenchmarkLoad(state, labels[i], filename, texture_filename);
+    } else {
+      SkipBenchmark(state, text_name, "couldn't write the model");
+      SkipBenchmark(state, cache_name, "couldn't write the model");
+    }
+    unlink(filename);
+    unlink(cache_filename);
+  }
+}
+
+//
+// Frames
+//
+
+internal BENCHMARK_PROC(RenderFrames) {
+  GameOffscreenBuffer *buffer = (GameOffscreenBuffer *)data;
+  for (int i = 0; i < iterations; ++i) {
+    Render(buffer);
+  }
+}
+
+struct ShadowBenchmark {
+  GameOffscreenBuffer map;
+  v3 light_direction;
+};
+
+internal BENCHMARK_PROC(RenderShadowMaps) {
+  ShadowBenchmark *bench = (ShadowBenchmark *)data;
+  for (int i = 0; i < iterations; ++i) {
+    RenderShadowMap(&bench->map, &g_transient_arena, bench->light_direction);
+  }
+}
+
+internal void BenchmarkFrames(BenchmarkState *state,
+                              GameOffscreenBuffer *buffer) {
+  v2i sizes[] = {{320, 240},
+                 {640, 480},
+                 {1000, 1000},
+                 {1920, 1080},
+                 {buffer->max_width, buffer->max_height}};
+  for (int i = 0; i < (int)COUNT_OF(sizes); ++i) {
+    char name[64];
+    snprintf(name, sizeof(name), "render/%dx%d", sizes[i].x, sizes[i].y);
+    ResizeBuffer(buffer, sizes[i].x, sizes[i].y);
+    RunBenchmark(state, name, RenderFrames, buffer,
+                 (r64)sizes[i].x * sizes[i].y, "pixels");
+  }
+
+  // The other shading modes at one size
+  ShadingMode modes[] = {Shading_Visibility, Shading_DepthPrepass};
+  const char *mode_names[] = {"visibility", "prepass"};
+  ResizeBuffer(buffer, 1000, 1000);
+  for (int i = 0; i < (int)COUNT_OF(modes); ++i) {
+    char name[64];
+    snprintf(name, sizeof(name), "render/1000x1000/%s", mode_names[i]);
+    g_render_settings.shading = modes[i];
+    RunBenchmark(state, name, RenderFrames, buffer, 1000.0 * 1000.0,
+                 "pixels");
+  }
+  g_render_settings.shading = Shading_Forward;
+
+  g_render_settings.wireframe = Wireframe_Only;
+  RunBenchmark(state, "render/1000x1000/wireframe", RenderFrames, buffer,
+               g_model.edge_count, "edges");
+  g_render_settings.wireframe = Wireframe_Off;
+
+  const int kShadowMapSize = 1024;
+  if (IsBenchmarkSelected(state, "shadow/1024")) {
+    TemporaryMemory temp = BeginTemporaryMemory(&g_permanent_arena);
+    ShadowBenchmark bench = {};
+    bench.light_direction = Normalize({0.5f, -0.5f, -1.0f});
+    if (AllocateShadowMap(&bench.map, &g_permanent_arena, kShadowMapSize)) {
+      RunBenchmark(state, "shadow/1024", RenderShadowMaps, &bench,
+                   (r64)kShadowMapSize * kShadowMapSize, "pixels");
+    } else {
+      SkipBenchmark(state, "shadow/1024", "the map doesn't fit");
+    }
+    EndTemporaryMemory(temp);
+  }
+}
+
+//
+// Frame sink
+//
+
+struct SinkBenchmark {
+  u32 *pixels;  // a frame of the model, opaque
+  int pixel_count;
+  int width;
+  int height;
+  u8 *out;
+};
+
+internal BENCHMARK_PROC(ConvertFrames) {
+  SinkBenchmark *bench = (SinkBenchmark *)data;
+  for (int i = 0; i < iterations; ++i) {
+    ConvertBGRAToRGB(bench->pixels, bench->pixel_count, bench->out);
+  }
+}
+
+internal BENCHMARK_PROC(EncodeFrames) {
+  SinkBenchmark *bench = (SinkBenchmark *)data;
+  for (int i = 0; i < iterations; ++i) {
+    EncodeQOI(bench->pixels, bench->width, bench->height, bench->out);
+  }
+}
+
+// What the sink does with a frame before the writes, on a frame of the
+// model so that QOI sees realistic runs
+internal void BenchmarkSink(BenchmarkState *state,
+                            GameOffscreenBuffer *buffer) {
+  if (!IsBenchmarkSelected(state, "sink/rgb24") &&
+      !IsBenchmarkSelected(state, "sink/qoi")) {
+    return;
+  }
+
+  ResizeBuffer(buffer, 1000, 1000);
+  Render(buffer);
+
+  TemporaryMemory temp = BeginTemporaryMemory(&g_permanent_arena);
+  SinkBenchmark bench = {};
+  bench.width = buffer->width;
+  bench.height = buffer->height;
+  bench.pixel_count = bench.width * bench.height;
+  bench.pixels = PushArray(&g_permanent_arena, bench.pixel_count, u32);
+  bench.out = (u8 *)PushSize(&g_permanent_arena,
+                             GetMaxQOISize(bench.width, bench.height));
+  if (bench.pixels && bench.out) {
+    ConvertToOpaqueBGRA((u32 *)buffer->memory, bench.pixel_count,
+                        bench.pixels);
+    RunBenchmark(state, "sink/rgb24", ConvertFrames, &bench,
+                 bench.pixel_count, "pixels");
+    RunBenchmark(state, "sink/qoi", EncodeFrames, &bench, bench.pixel_count,
+                 "pixels");
+  } else {
+    SkipBenchmark(state, "sink/", "the frames don't fit");
+  }
+  EndTemporaryMemory(temp);
+}
+
+//
+// Setup and reporting
+//
+
+// Uncompressed 24 bit TGA of a checkerboard with a gradient, so every mip
+// level differs
+internal bool32 WriteBenchmarkTexture(const char *filename, int texels) {
+  u64 size = 18 + (u64)texels * texels * 3;
+  TemporaryMemory temp = BeginTemporaryMemory(&g_transient_arena);
+  u8 *file = PushZeroArray(&g_transient_arena, size, u8);
+  bool32 result = false;
+  if (file) {
+    file[2] = 2;  // uncompressed true color
+    file[12] = (u8)(texels & 0xFF);
+    file[13] = (u8)(texels >> 8);
+    file[14] = (u8)(texels & 0xFF);
+    file[15] = (u8)(texels >> 8);
+    file[16] = 24;
+    u8 *texel = file + 18;
+    for (int y = 0; y < texels; ++y) {
+      for (int x = 0; x < texels; ++x) {
+        u8 check = ((x >> 4) ^ (y >> 4)) & 1 ? 0xFF : 0x40;
+        *texel++ = check;
+        *texel++ = (u8)(x >> 2);
+        *texel++ = (u8)(y >> 2);
+      }
+    }
+    result = PlatformWriteEntireFile(filename, file, size);
+  }
+  EndTemporaryMemory(temp);
+  return result;
+}
+
+internal void PrintDuration(r64 ns) {
+  if (ns < 10000.0) {
+    printf("%9.1f ns", ns);
+  } else if (ns < 10000000.0) {
+    printf("%9.2f us", ns / 1000.0);
+  } else {
+    printf("%9.2f ms", ns / 1000000.0);
+  }
+}
+
+internal const char *GetVerdictName(BenchmarkVerdict verdict) {
+  switch (verdict) {
+    case Verdict_New: return "new";
+    case Verdict_Unchanged: return "unchanged";
+    case Verdict_Faster: return "faster";
+    case Verdict_Slower: return "slower";
+  }
+  return "";
+}
+
+internal void PrintResults(BenchmarkState *state) {
+  printf("%-28s  %12s  %12s  %14s  %s\n", "benchmark", "median", "MAD",
+         "M items/s", "vs baseline");
+  for (int i = 0; i < state->result_count; ++i) {
+    BenchmarkResult *result = &state->results[i];
+    printf("%-28s  ", result->name);
+    if (result->skipped) {
+      printf("skipped, %s\n", result->skipped);
+      continue;
+    }
+    PrintDuration(result->median_ns);
+    printf("  ");
+    PrintDuration(result->mad_ns);
+    printf("  %8.2f %-5s", result->items / result->median_ns * 1000.0,
+           result->item_name);
+    if (result->verdict == Verdict_New) {
+      printf("  new\n");
+    } else {
+      printf("  %+.1f%% (threshold %.1f%%) %s\n", 100.0 * result->change,
+             100.0 * result->threshold, GetVerdictName(result->verdict));
+    }
+  }
+}
+
+// One result per line, which is what FindBaseline reads
+internal bool32 WriteResults(BenchmarkState *state, const char *filename) {
+  FILE *file = fopen(filename, "wb");
+  if (!file) return false;
+
+  fprintf(file, "{\"simd_width\": %d, \"threads\": %d, \"benchmarks\": [\n",
+          RASTER_SIMD_WIDTH, state->options.thread_count);
+  for (int i = 0; i < state->result_count; ++i) {
+    BenchmarkResult *result = &state->results[i];
+    const char *separator = i + 1 < state->result_count ? "," : "";
+    if (result->skipped) {
+      fprintf(file, "{\"name\": \"%s\", \"skipped\": \"%s\"}%s\n",
+              result->name, result->skipped, separator);
+      continue;
+    }
+    fprintf(file,
+            "{\"name\": \"%s\", \"median_ns\": %.3f, \"mad_ns\": %.3f, "
+            "\"min_ns\": %.3f, \"samples\": %d, \"iterations\": %d, "
+            "\"items\": %.1f, \"item\": \"%s\", \"items_per_second\": %.1f",
+            result->name, result->median_ns, result->mad_ns, result->min_ns,
+            result->samples, result->iterations, result->items,
+            result->item_name, result->items / result->median_ns * 1e9);
+    if (result->verdict != Verdict_New) {
+      fprintf(file,
+              ", \"baseline_median_ns\": %.3f, \"change\": %.4f, "
+              "\"threshold\": %.4f",
+              result->baseline_median_ns, result->change,
+              result->threshold);
+    }
+    fprintf(file, ", \"verdict\": \"%s\"}%s\n",
+            GetVerdictName(result->verdict), separator);
+  }
+  fprintf(file, "]}\n");
+
+  bool32 result = !ferror(file);
+  if (fclose(file) != 0) result = false;
+  return result;
+}
+
+// The baseline stays in the permanent arena, 0 terminated
+internal bool32 ReadBaseline(BenchmarkState *state, const char *filename) {
+  TemporaryMemory temp = BeginTemporaryMemory(&g_transient_arena);
+  FileReadResult file = PlatformReadEntireFile(filename, &g_transient_arena);
+  if (file.memory) {
+    state->baseline =
+        PushArray(&g_permanent_arena, file.memory_size + 1, char);
+    if (state->baseline) {
+      memcpy(state->baseline, file.memory, file.memory_size);
+      state->baseline[file.memory_size] = '\0';
+    }
+  }
+  EndTemporaryMemory(temp);
+  return state->baseline != 0;
+}
+
+internal void PrintUsage(const char *program) {
+  fprintf(stderr,
+          "Usage: %s [-d data_dir] [-g temp_dir] [-o results.json] "
+          "[-b baseline.json] [-f filter] [-t threads]\n"
+          "  -o writes the results as JSON, which a later run takes as "
+          "its -b baseline\n"
+          "  -f runs the benchmarks with that in their name, like "
+          "triangle/ or render/\n"
+          "  Exits with 1 if anything is slower than the baseline beyond "
+          "the noise\n",
+          program);
+}
+
+internal bool32 ParseOptions(int argc, char **argv,
+                             BenchmarkOptions *options) {
+  options->data_path = "data";
+  options->temp_path = "/tmp";
+  options->output_path = 0;
+  options->baseline_path = 0;
+  options->filter = 0;
+  options->thread_count =
+      Min(Max((int)sysconf(_SC_NPROCESSORS_ONLN), 1), kMaxThreadCount);
+
+  for (int i = 1; i < argc; i += 2) {
+    char *arg = argv[i];
+    char *value = (i + 1 < argc) ? argv[i + 1] : 0;
+    if (!value) return false;
+
+    if (strcmp(arg, "-d") == 0) {
+      options->data_path = value;
+    } else if (strcmp(arg, "-g") == 0) {
+      options->temp_path = value;
+    } else if (strcmp(arg, "-o") == 0) {
+      options->output_path = value;
+    } else if (strcmp(arg, "-b") == 0) {
+      options->baseline_path = value;
+    } else if (strcmp(arg, "-f") == 0) {
+      options->filter = value;
+    } else if (strcmp(arg, "-t") == 0) {
+      options->thread_count = atoi(value);
+    } else {
+      return false;
+    }
+  }
+
+  return options->thread_count >= 0 &&
+         options->thread_count <= kMaxThreadCount;
+}
+
+int main(int argc, char **argv) {
+  BenchmarkState state = {};
+  if (!ParseOptions(argc, argv, &state.options)) {
+    PrintUsage(argv[0]);
+    return 2;
+  }
+  BenchmarkOptions *options = &state.options;
+
+  GameMemory memory = {};
+  memory.permanent_storage_size = Megabytes(512);
+  memory.transient_storage_size = Megabytes(512);
+  u8 *storage = (u8 *)PlatformAllocateMemory(memory.permanent_storage_size +
+                                             memory.transient_storage_size);
+  memory.permanent_storage = storage;
+  memory.transient_storage = storage + memory.permanent_storage_size;
+  if (!storage || !InitializeRenderer(&memory)) {
+    fprintf(stderr, "Cannot reserve the memory\n");
+    return 2;
+  }
+
+  state.max_result_count = kMaxBenchmarks;
+  state.results =
+      PushArray(&g_permanent_arena, kMaxBenchmarks, BenchmarkResult);
+  GameOffscreenBuffer buffer = {};
+  if (!state.results ||
+      !AllocateBuffer(&buffer, &g_permanent_arena, 2000, 1500)) {
+    fprintf(stderr, "Not enough memory\n");
+    return 2;
+  }
+  if (options->baseline_path && !ReadBaseline(&state, options->baseline_path)) {
+    return 2;
+  }
+
+  PlatformWorkQueue render_queue = {};
+  if (options->thread_count > 1) {
+    LinuxMakeQueue(&render_queue, options->thread_count - 1);
+    g_render_queue = &render_queue;
+  }
+  g_render_settings.binned = options->thread_count > 0;
+  g_render_settings.thread_count = options->thread_count;
+
+  char texture_filename[512];
+  char load_texture_filename[512];
+  snprintf(texture_filename, sizeof(texture_filename),
+           "%s/renderer_benchmark_texture.tga", options->temp_path);
+  snprintf(load_texture_filename, sizeof(load_texture_filename),
+           "%s/renderer_benchmark_load_texture.tga", options->temp_path);
+  Texture texture = {};
+  TGAImage image;
+  if (!WriteBenchmarkTexture(texture_filename, kTextureSize) ||
+      !WriteBenchmarkTexture(load_texture_filename, kLoadTextureSize) ||
+      !image.read_tga_file(texture_filename) ||
+      !LoadTexture(&texture, &g_permanent_arena, &image)) {
+    fprintf(stderr, "Cannot make the texture in %s\n", options->temp_path);
+    return 2;
+  }
+
+  BenchmarkTriangles(&state, &buffer, &texture);
+  BenchmarkLines(&state, &buffer);
+
+  char model_filename[512];
+  snprintf(model_filename, sizeof(model_filename), "%s/african_head.model",
+           options->data_path);
+  BenchmarkLoad(&state, "african_head", model_filename,
+                load_texture_filename);
+  BenchmarkSyntheticLoads(&state, load_texture_filename);
+
+  // Frames of the shipped model
+  LoadModelFromFile(&g_model, &g_transient_arena, model_filename,
+                    texture_filename, FaceOrder_File);
+  if (g_model.is_loaded) {
+    BenchmarkFrames(&state, &buffer);
+    BenchmarkSink(&state, &buffer);
+  } else {
+    SkipBenchmark(&state, "render/", "the model didn't load");
+  }
+  unlink(texture_filename);
+  unlink(load_texture_filename);
+
+  PrintResults(&state);
+  if (options->output_path &&
+      !WriteResults(&state, options->output_path)) {
+    fprintf(stderr, "Cannot write %s\n", options->output_path);
+    return 2;
+  }
+
+  for (int i = 0; i < state.result_count; ++i) {
+    if (state.results[i].verdict == Verdict_Slower) return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,50 @@
+#ifndef LINUX_BENCHMARK_H
+#define LINUX_BENCHMARK_H
+
+struct BenchmarkOptions {
+  const char *data_path;      // directory with african_head.model
+  const char *temp_path;      // where the synthetic files are written
+  const char *output_path;    // JSON results, if anywhere
+  const char *baseline_path;  // JSON results of an earlier run
+  const char *filter;         // only the benchmarks with this in the name
+  int thread_count;
+};
+
+enum BenchmarkVerdict {
+  Verdict_New,  // not in the baseline
+  Verdict_Unchanged,
+  Verdict_Faster,
+  Verdict_Slower,
+};
+
+struct BenchmarkResult {
+  char name[64];
+  const char *skipped;  // why it wasn't run, or 0
+
+  // Times are per iteration, over the samples
+  int iterations;  // per sample
+  int samples;
+  r64 min_ns;
+  r64 median_ns;
+  r64 mad_ns;  // median absolute deviation
+
+  r64 items;  // per iteration
+  const char *item_name;
+
+  BenchmarkVerdict verdict;
+  r64 baseline_median_ns;
+  r64 change;     // of the median, relative to the baseline
+  r64 threshold;  // a change beyond it isn't noise
+};
+
+struct BenchmarkState {
+  BenchmarkOptions options;
+
+  BenchmarkResult *results;
+  int result_count;
+  int max_result_count;
+
+  char *baseline;  // the baseline file as text, 0 terminated
+};
+
+#endif
@@ -0,0 +1,273 @@
+#ifndef LINUX_PLATFORM_CPP
+#define LINUX_PLATFORM_CPP
+
+// Platform services for Linux, shared by the renderer and the benchmark.
+// Each program includes this, then renderer.cpp
+
+#include "renderer_platform.h"
+
+// Libs
+#include "../libs/tgaimage.h"
+#include "../libs/tgaimage.cpp"
+
+#include "renderer.h"
+#include <fcntl.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "linux_platform.h"
+
+void *PlatformAllocateMemory(u64 size) {
+  // Anonymous mappings are zero-initialized, same as VirtualAlloc
+  void *result = mmap(0, size, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (result == MAP_FAILED) return 0;
+  return result;
+}
+
+void PlatformFreeMemory(void *memory, u64 size) {
+  if (memory) munmap(memory, size);
+}
+
+// The file is pushed onto the arena, callers pop it with a temporary scope
+FileReadResult PlatformReadEntireFile(const char *filename,
+                                      MemoryArena *arena) {
+  FileReadResult result = {};
+
+  int file_handle = open(filename, O_RDONLY);
+  if (file_handle == -1) {
+    fprintf(stderr, "Cannot read from file %s\n", filename);
+    return result;
+  }
+
+  struct stat file_status;
+  if (fstat(file_handle, &file_status) == -1) {
+    fprintf(stderr, "Cannot get file size\n");
+    close(file_handle);
+    return result;
+  }
+
+  result.memory_size = file_status.st_size;
+  result.memory = PushSize(arena, result.memory_size);
+
+  u64 bytes_read = 0;
+  while (result.memory && bytes_read < result.memory_size) {
+    ssize_t chunk = read(file_handle, (u8 *)result.memory + bytes_read,
+                         result.memory_size - bytes_read);
+    if (chunk <= 0) break;
+    bytes_read += chunk;
+  }
+  close(file_handle);
+
+  if (!result.memory || bytes_read != result.memory_size) {
+    fprintf(stderr, "Cannot read the whole file %s\n", filename);
+    result = {};
+  }
+
+  return result;
+}
+
+// Read-only view of the whole file, released with PlatformUnmapFile
+FileReadResult PlatformMapFile(const char *filename) {
+  FileReadResult result = {};
+
+  int file_handle = open(filename, O_RDONLY);
+  if (file_handle == -1) return result;
+
+  struct stat file_status;
+  if (fstat(file_handle, &file_status) == 0 && file_status.st_size > 0) {
+    void *memory = mmap(0, file_status.st_size, PROT_READ, MAP_PRIVATE,
+                        file_handle, 0);
+    if (memory != MAP_FAILED) {
+      result.memory = memory;
+      result.memory_size = file_status.st_size;
+    }
+  }
+  // The mapping stays valid after the file is closed
+  close(file_handle);
+
+  return result;
+}
+
+void PlatformUnmapFile(FileReadResult *file) {
+  if (file->memory) munmap(file->memory, file->memory_size);
+  *file = {};
+}
+
+// Writes to a temporary file first and renames it over the target, so
+// nobody ever sees a half-written file
+bool32 PlatformWriteEntireFile(const char *filename, void *memory, u64 size) {
+  char temp_filename[512];
+  snprintf(temp_filename, sizeof(temp_filename), "%s.%d.tmp", filename,
+           (int)getpid());
+
+  int file_handle = open(temp_filename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (file_handle == -1) {
+    fprintf(stderr, "Cannot write to file %s\n", temp_filename);
+    return false;
+  }
+
+  u64 bytes_written = 0;
+  while (bytes_written < size) {
+    ssize_t chunk = write(file_handle, (u8 *)memory + bytes_written,
+                          size - bytes_written);
+    if (chunk <= 0) break;
+    bytes_written += chunk;
+  }
+  close(file_handle);
+
+  if (bytes_written != size || rename(temp_filename, filename) != 0) {
+    fprintf(stderr, "Cannot write the whole file %s\n", filename);
+    unlink(temp_filename);
+    return false;
+  }
+
+  return true;
+}
+
+// 0 if the file doesn't exist
+u64 PlatformGetLastWriteTime(const char *filename) {
+  struct stat file_status;
+  if (stat(filename, &file_status) != 0) return 0;
+
+  u64 result = (u64)file_status.st_mtim.tv_sec * 1000000000ull +
+               file_status.st_mtim.tv_nsec;
+  return result;
+}
+
+void PlatformAddWorkEntry(PlatformWorkQueue *queue,
+                          PlatformWorkQueueCallback *callback, void *data) {
+  u32 new_next_entry_to_write =
+      (queue->next_entry_to_write + 1) % COUNT_OF(queue->entries);
+  Assert(new_next_entry_to_write != queue->next_entry_to_read);
+
+  PlatformWorkQueueEntry *entry = &queue->entries[queue->next_entry_to_write];
+  entry->callback = callback;
+  entry->data = data;
+  ++queue->completion_goal;
+
+  // The entry must be complete before the workers can see it
+  __sync_synchronize();
+  queue->next_entry_to_write = new_next_entry_to_write;
+  sem_post(&queue->semaphore);
+}
+
+// Returns true if there was nothing to do
+internal bool32 LinuxDoNextWorkQueueEntry(PlatformWorkQueue *queue) {
+  bool32 we_should_sleep = false;
+
+  u32 original_next_entry_to_read = queue->next_entry_to_read;
+  u32 new_next_entry_to_read =
+      (original_next_entry_to_read + 1) % COUNT_OF(queue->entries);
+  if (original_next_entry_to_read != queue->next_entry_to_write) {
+    u32 index = __sync_val_compare_and_swap(&queue->next_entry_to_read,
+                                            original_next_entry_to_read,
+                                            new_next_entry_to_read);
+    if (index == original_next_entry_to_read) {
+      PlatformWorkQueueEntry entry = queue->entries[index];
+      entry.callback(queue, entry.data);
+      __sync_fetch_and_add(&queue->completion_count, 1);
+    }
+  } else {
+    we_should_sleep = true;
+  }
+
+  return we_should_sleep;
+}
+
+void PlatformCompleteAllWork(PlatformWorkQueue *queue) {
+  while (queue->completion_goal != queue->completion_count) {
+    LinuxDoNextWorkQueueEntry(queue);
+  }
+
+  queue->completion_goal = 0;
+  queue->completion_count = 0;
+}
+
+internal void *LinuxThreadProc(void *parameter) {
+  PlatformWorkQueue *queue = (PlatformWorkQueue *)parameter;
+
+  for (;;) {
+    if (LinuxDoNextWorkQueueEntry(queue)) {
+      sem_wait(&queue->semaphore);
+    }
+  }
+
+  return 0;
+}
+
+internal void LinuxMakeQueue(PlatformWorkQueue *queue, int thread_count) {
+  queue->completion_goal = 0;
+  queue->completion_count = 0;
+  queue->next_entry_to_write = 0;
+  queue->next_entry_to_read = 0;
+  sem_init(&queue->semaphore, 0, 0);
+
+  for (int i = 0; i < thread_count; ++i) {
+    pthread_t thread;
+    pthread_create(&thread, 0, LinuxThreadProc, queue);
+    pthread_detach(thread);
+  }
+}
+
+void PlatformInitSemaphore(PlatformSemaphore *semaphore, u32 initial_count) {
+  sem_init(&semaphore->semaphore, 0, initial_count);
+}
+
+void PlatformSignalSemaphore(PlatformSemaphore *semaphore) {
+  sem_post(&semaphore->semaphore);
+}
+
+void PlatformWaitForSemaphore(PlatformSemaphore *semaphore) {
+  // Interrupted by a signal, keep waiting
+  while (sem_wait(&semaphore->semaphore) == -1) {
+  }
+}
+
+struct LinuxThreadStart {
+  PlatformThreadProc *proc;
+  void *data;
+};
+
+internal void *LinuxStartThreadProc(void *parameter) {
+  LinuxThreadStart start = *(LinuxThreadStart *)parameter;
+  free(parameter);
+  start.proc(start.data);
+  return 0;
+}
+
+// The thread runs until the process exits
+void PlatformStartThread(PlatformThreadProc *proc, void *data) {
+  LinuxThreadStart *start = (LinuxThreadStart *)malloc(sizeof(*start));
+  start->proc = proc;
+  start->data = data;
+
+  pthread_t thread;
+  pthread_create(&thread, 0, LinuxStartThreadProc, start);
+  pthread_detach(thread);
+}
+
+// Nanoseconds from some fixed point in the past
+u64 PlatformGetWallClock() {
+  timespec time;
+  clock_gettime(CLOCK_MONOTONIC, &time);
+  u64 result = (u64)time.tv_sec * 1000000000ull + time.tv_nsec;
+  return result;
+}
+
+void PlatformSleep(u64 ns) {
+  timespec time;
+  time.tv_sec = (time_t)(ns / 1000000000ull);
+  time.tv_nsec = (long)(ns % 1000000000ull);
+  // Interrupted by a signal, sleep the rest
+  while (nanosleep(&time, &time) == -1) {
+  }
+}
+
+#endif  // LINUX_PLATFORM_CPP
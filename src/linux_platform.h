@@ -0,0 +1,24 @@
+#ifndef LINUX_PLATFORM_H
+#define LINUX_PLATFORM_H
+
+struct PlatformWorkQueueEntry {
+  PlatformWorkQueueCallback *callback;
+  void *data;
+};
+
+struct PlatformWorkQueue {
+  u32 volatile completion_goal;
+  u32 volatile completion_count;
+
+  u32 volatile next_entry_to_write;
+  u32 volatile next_entry_to_read;
+  sem_t semaphore;
+
+  PlatformWorkQueueEntry entries[kPlatformWorkQueueSize];
+};
+
+struct PlatformSemaphore {
+  sem_t semaphore;
+};
+
+#endif
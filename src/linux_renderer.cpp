@@ -0,0 +1,822 @@
+#include "linux_platform.cpp"
+#include "linux_renderer.h"
+
+// Above this line are the platform service functions
+#include "renderer.cpp"
+
+global FrameLoop g_frame_loop;
+global LinuxFrameImage g_frame_image;  // written by the presenter
+global FrameSink *g_frame_sink;        // fed by the presenter, or 0
+
+// Size of the backbuffers, batches allocate frames of any size
+const int kMaxFrameWidth = 2000;
+const int kMaxFrameHeight = 1500;
+
+inline r32 LinuxGetMsElapsed(u64 start, u64 end) {
+  r32 result = (r32)(end - start) / 1000000.0f;
+  return result;
+}
+
+// The presenter encodes every frame, so that writing the last one out
+// only has to wait for the file, and streams them to the sink
+internal PRESENT_FRAME(LinuxPresentFrame) {
+  TIMED_BLOCK(Present);
+  if (g_frame_sink) SubmitFrame(g_frame_sink, buffer);
+
+  LinuxFrameImage *image = (LinuxFrameImage *)data;
+  if (!image->rgb) return;
+  if (image->buffer == buffer && image->generation == buffer->generation &&
+      image->width == buffer->width && image->height == buffer->height) {
+    return;  // encoded already
+  }
+  image->buffer = buffer;
+  image->generation = buffer->generation;
+  image->width = buffer->width;
+  image->height = buffer->height;
+
+  // The backbuffer is top-down 0x00RRGGBB, same as PPM, only wider
+  int pitch = buffer->width * buffer->bytes_per_pixel;
+  for (int y = 0; y < buffer->height; ++y) {
+    u32 *row = (u32 *)((u8 *)buffer->memory + y * pitch);
+    ConvertBGRAToRGB(row, buffer->width, image->rgb + y * buffer->width * 3);
+  }
+}
+
+internal bool32 LinuxWritePPM(LinuxFrameImage *image, const char *filename) {
+  FILE *file = fopen(filename, "wb");
+  if (!file) return false;
+
+  fprintf(file, "P6\n%d %d\n255\n", image->width, image->height);
+  fwrite(image->rgb, 3, (u64)image->width * image->height, file);
+
+  fclose(file);
+  return true;
+}
+
+// Depth as gray, closer is brighter and nothing is black
+internal bool32 LinuxWriteDepthPGM(GameOffscreenBuffer *map,
+                                   const char *filename) {
+  FILE *file = fopen(filename, "wb");
+  if (!file) return false;
+
+  fprintf(file, "P5\n%d %d\n255\n", map->width, map->height);
+  for (int y = map->height - 1; y >= 0; --y) {
+    for (int x = 0; x < map->width; ++x) {
+      // Depth is in [0, height] for the model
+      int depth = GetShadowMapDepth(map, x, y);
+      int gray = 0;
+      if (depth != INT_MIN) {
+        gray = Min(Max(1 + depth * 254 / map->height, 1), 255);
+      }
+      fputc(gray, file);
+    }
+  }
+
+  bool32 result = !ferror(file);
+  if (fclose(file) != 0) result = false;
+  return result;
+}
+
+// Writes the frame straight from the backbuffer, for the threads that
+// don't go through the presenter
+internal bool32 LinuxWriteBufferPPM(GameOffscreenBuffer *buffer,
+                                    const char *filename) {
+  FILE *file = fopen(filename, "wb");
+  if (!file) return false;
+
+  fprintf(file, "P6\n%d %d\n255\n", buffer->width, buffer->height);
+  const int kChunkSize = 1024;
+  u8 rgb[kChunkSize * 3];
+  int pitch = buffer->width * buffer->bytes_per_pixel;
+  for (int y = 0; y < buffer->height; ++y) {
+    u32 *row = (u32 *)((u8 *)buffer->memory + y * pitch);
+    for (int x = 0; x < buffer->width; x += kChunkSize) {
+      int count = Min(kChunkSize, buffer->width - x);
+      ConvertBGRAToRGB(row + x, count, rgb);
+      fwrite(rgb, 3, count, file);
+    }
+  }
+
+  bool32 result = !ferror(file);
+  if (fclose(file) != 0) result = false;
+  return result;
+}
+
+struct LinuxBatchOutput {
+  const char *pattern;  // printf pattern for the frame index
+  i32 volatile failed_count;
+};
+
+internal BATCH_FRAME(LinuxWriteBatchFrame) {
+  LinuxBatchOutput *output = (LinuxBatchOutput *)data;
+  char filename[4096];
+  int length = snprintf(filename, sizeof(filename), output->pattern,
+                        frame_index);
+  if (length < 0 || length >= (int)sizeof(filename) ||
+      !LinuxWriteBufferPPM(buffer, filename)) {
+    AtomicAddI32(&output->failed_count, 1);
+  }
+}
+
+internal FRAME_SINK_WRITE(LinuxWriteSinkFrame) {
+  LinuxSinkOutput *output = (LinuxSinkOutput *)data;
+  if (output->pattern) {
+    char filename[4096];
+    int length = snprintf(filename, sizeof(filename), output->pattern,
+                          frame_index);
+    bool32 result = length >= 0 && length < (int)sizeof(filename) &&
+                    PlatformWriteEntireFile(filename, bytes, size);
+    return result;
+  }
+
+  u64 bytes_written = 0;
+  while (bytes_written < size) {
+    ssize_t chunk = write(output->file_handle, (u8 *)bytes + bytes_written,
+                          size - bytes_written);
+    if (chunk <= 0) break;
+    bytes_written += chunk;
+  }
+  return bytes_written == size;
+}
+
+// The pattern gets the frame index, so it has to have exactly one %d,
+// with an optional width, and nothing else for printf
+internal bool32 LinuxIsFramePattern(const char *pattern) {
+  int index_count = 0;
+  for (const char *at = pattern; *at; ++at) {
+    if (*at != '%') continue;
+    ++at;
+    if (*at == '%') continue;
+    while (*at >= '0' && *at <= '9') ++at;
+    if (*at != 'd') return false;
+    index_count++;
+  }
+  return index_count == 1;
+}
+
+internal int CompareReal32(const void *a, const void *b) {
+  r32 x = *(const r32 *)a;
+  r32 y = *(const r32 *)b;
+  return (x > y) - (x < y);
+}
+
+internal void LinuxPrintUsage(const char *program) {
+  fprintf(stderr,
+          "Usage: %s [-w width] [-h height] [-n frames] [-d data_dir] "
+          "[-g model] "
+          "[-o frame.ppm] [-f fps] [-r halfspace|subpixel|scanline] "
+          "[-k simd|scalar] [-t threads] [-S] [-m file|locality|front] "
+          "[-l mip|base] [-p camera_distance] [-u perspective|affine] "
+          "[-s flat|gouraud] [-c texture|white] [-a transparency] "
+          "[-v forward|visibility|prepass] [-e off|overlay|only] "
+          "[-i full|incremental] [-P] [-j trace.json] [-z shadow.pgm] "
+          "[-b orbit:frames[:pitch]|views.txt] "
+          "[-x rgb24|bgra|ppm|qoi[:path]]\n"
+          "  -g draws that model of the data directory instead of "
+          "african_head.model\n"
+          "  -f sleeps between frames to draw at most that many per "
+          "second\n"
+          "  -r subpixel draws each pixel of the surface exactly once\n"
+          "  -t 0 draws without binning, -S reports scaling from 1 to "
+          "threads\n"
+          "  -m reorders the faces at load for vertex locality, and "
+          "optionally front to back\n"
+          "  -l base samples the full size texture only\n"
+          "  -p views the model in perspective from that far out on z, "
+          "more than 1\n"
+          "  -u affine skips the perspective correction of the texture\n"
+          "  -a from 0 to 1 blends the model over the background\n"
+          "  -v visibility draws triangle IDs first and shades each pixel "
+          "once,\n"
+          "     prepass draws depth first and shades at that depth only\n"
+          "  -e draws every edge of the model, over it or instead of it\n"
+          "  -i incremental skips the frames the scene hasn't changed "
+          "in\n"
+          "  -P reports the timed blocks and the pipeline counters, -j "
+          "writes the\n"
+          "     blocks out as Chrome trace JSON (BUILD_INTERNAL only)\n"
+          "  -z times the shadow map of the light and writes its depth\n"
+          "  -b draws an orbit or one view per line of the file, \"yaw "
+          "[pitch\n"
+          "     [camera_distance [light_x light_y light_z]]]\", in "
+          "parallel, -o is then\n"
+          "     a pattern like frame_%%04d.ppm\n"
+          "  -x streams every frame to the path on a writer thread, raw "
+          "rgb24 or bgra\n"
+          "     to a file or - for stdout (the default, the report goes to "
+          "stderr then),\n"
+          "     ppm or qoi to a pattern like frame_%%04d.qoi\n",
+          program);
+}
+
+internal bool32 LinuxParseOptions(int argc, char **argv,
+                                  LinuxOptions *options) {
+  options->width = 1000;
+  options->height = 1000;
+  options->frame_count = 100;
+  options->data_path = 0;
+  options->model_path = 0;
+  options->ppm_path = 0;
+  options->target_fps = 0;
+  options->rasterizer = Rasterizer_HalfSpace;
+  options->scalar_only = false;
+  // Larger machines draw on as many threads as the queue allows, only
+  // an explicit -t beyond it is an error
+  options->thread_count =
+      Min(Max((int)sysconf(_SC_NPROCESSORS_ONLN), 1), kMaxThreadCount);
+  options->report_scaling = false;
+  options->face_order = FaceOrder_File;
+  options->base_level_only = false;
+  options->camera_distance = 0;
+  options->affine_texture = false;
+  options->gouraud = false;
+  options->untextured = false;
+  options->transparency = 0;
+  options->shading = Shading_Forward;
+  options->wireframe = Wireframe_Off;
+  options->incremental = false;
+  options->report_profile = false;
+  options->trace_path = 0;
+  options->shadow_path = 0;
+  options->batch_path = 0;
+  options->orbit_frame_count = 0;
+  options->orbit_pitch = 0;
+  options->sink_path = 0;
+  options->sink_format = FrameSink_RGB24;
+
+  for (int i = 1; i < argc; ++i) {
+    char *arg = argv[i];
+    if (strcmp(arg, "-S") == 0) {
+      options->report_scaling = true;
+      continue;
+    }
+    if (strcmp(arg, "-P") == 0) {
+      options->report_profile = true;
+      continue;
+    }
+
+    char *value = (i + 1 < argc) ? argv[i + 1] : 0;
+    if (!value) return false;
+
+    if (strcmp(arg, "-w") == 0) {
+      options->width = atoi(value);
+    } else if (strcmp(arg, "-h") == 0) {
+      options->height = atoi(value);
+    } else if (strcmp(arg, "-n") == 0) {
+      options->frame_count = atoi(value);
+    } else if (strcmp(arg, "-d") == 0) {
+      options->data_path = value;
+    } else if (strcmp(arg, "-g") == 0) {
+      options->model_path = value;
+    } else if (strcmp(arg, "-o") == 0) {
+      options->ppm_path = value;
+    } else if (strcmp(arg, "-f") == 0) {
+      options->target_fps = atoi(value);
+    } else if (strcmp(arg, "-r") == 0) {
+      if (strcmp(value, "halfspace") == 0) {
+        options->rasterizer = Rasterizer_HalfSpace;
+      } else if (strcmp(value, "subpixel") == 0) {
+        options->rasterizer = Rasterizer_Subpixel;
+      } else if (strcmp(value, "scanline") == 0) {
+        options->rasterizer = Rasterizer_Scanline;
+      } else {
+        return false;
+      }
+    } else if (strcmp(arg, "-k") == 0) {
+      if (strcmp(value, "simd") == 0) {
+        options->scalar_only = false;
+      } else if (strcmp(value, "scalar") == 0) {
+        options->scalar_only = true;
+      } else {
+        return false;
+      }
+    } else if (strcmp(arg, "-t") == 0) {
+      options->thread_count = atoi(value);
+    } else if (strcmp(arg, "-m") == 0) {
+      if (strcmp(value, "file") == 0) {
+        options->face_order = FaceOrder_File;
+      } else if (strcmp(value, "locality") == 0) {
+        options->face_order = FaceOrder_Locality;
+      } else if (strcmp(value, "front") == 0) {
+        options->face_order = FaceOrder_FrontToBack;
+      } else {
+        return false;
+      }
+    } else if (strcmp(arg, "-l") == 0) {
+      if (strcmp(value, "mip") == 0) {
+        options->base_level_only = false;
+      } else if (strcmp(value, "base") == 0) {
+        options->base_level_only = true;
+      } else {
+        return false;
+      }
+    } else if (strcmp(arg, "-p") == 0) {
+      options->camera_distance = (r32)atof(value);
+      // Faces reaching behind the near plane are dropped
+      if (options->camera_distance <= 0) return false;
+    } else if (strcmp(arg, "-u") == 0) {
+      if (strcmp(value, "perspective") == 0) {
+        options->affine_texture = false;
+      } else if (strcmp(value, "affine") == 0) {
+        options->affine_texture = true;
+      } else {
+        return false;
+      }
+    } else if (strcmp(arg, "-s") == 0) {
+      if (strcmp(value, "flat") == 0) {
+        options->gouraud = false;
+      } else if (strcmp(value, "gouraud") == 0) {
+        options->gouraud = true;
+      } else {
+        return false;
+      }
+    } else if (strcmp(arg, "-c") == 0) {
+      if (strcmp(value, "texture") == 0) {
+        options->untextured = false;
+      } else if (strcmp(value, "white") == 0) {
+        options->untextured = true;
+      } else {
+        return false;
+      }
+    } else if (strcmp(arg, "-a") == 0) {
+      options->transparency = (r32)atof(value);
+      if (options->transparency < 0 || options->transparency > 1) {
+        return false;
+      }
+    } else if (strcmp(arg, "-v") == 0) {
+      if (strcmp(value, "forward") == 0) {
+        options->shading = Shading_Forward;
+      } else if (strcmp(value, "visibility") == 0) {
+        options->shading = Shading_Visibility;
+      } else if (strcmp(value, "prepass") == 0) {
+        options->shading = Shading_DepthPrepass;
+      } else {
+        return false;
+      }
+    } else if (strcmp(arg, "-e") == 0) {
+      if (strcmp(value, "off") == 0) {
+        options->wireframe = Wireframe_Off;
+      } else if (strcmp(value, "overlay") == 0) {
+        options->wireframe = Wireframe_Overlay;
+      } else if (strcmp(value, "only") == 0) {
+        options->wireframe = Wireframe_Only;
+      } else {
+        return false;
+      }
+    } else if (strcmp(arg, "-j") == 0) {
+      options->trace_path = value;
+    } else if (strcmp(arg, "-z") == 0) {
+      options->shadow_path = value;
+    } else if (strcmp(arg, "-b") == 0) {
+      if (strncmp(value, "orbit:", 6) == 0) {
+        char *end;
+        options->orbit_frame_count = (int)strtol(value + 6, &end, 10);
+        if (*end == ':') options->orbit_pitch = strtof(end + 1, &end);
+        if (*end || options->orbit_frame_count <= 0) return false;
+      } else {
+        options->batch_path = value;
+      }
+    } else if (strcmp(arg, "-x") == 0) {
+      const char *formats[] = {"rgb24", "bgra", "ppm", "qoi"};
+      const char *default_paths[] = {"-", "-", "frame_%04d.ppm",
+                                     "frame_%04d.qoi"};
+      const char *path = strchr(value, ':');
+      int length = path ? (int)(path - value) : (int)strlen(value);
+      options->sink_path = 0;
+      for (int f = 0; f < (int)COUNT_OF(formats); ++f) {
+        if ((int)strlen(formats[f]) == length &&
+            strncmp(value, formats[f], length) == 0) {
+          options->sink_format = (FrameSinkFormat)f;
+          options->sink_path = path ? path + 1 : default_paths[f];
+        }
+      }
+      if (!options->sink_path || !options->sink_path[0]) return false;
+    } else if (strcmp(arg, "-i") == 0) {
+      if (strcmp(value, "full") == 0) {
+        options->incremental = false;
+      } else if (strcmp(value, "incremental") == 0) {
+        options->incremental = true;
+      } else {
+        return false;
+      }
+    } else {
+      return false;
+    }
+    ++i;
+  }
+
+  return options->width > 0 && options->height > 0 &&
+         options->frame_count > 0 && options->target_fps >= 0 &&
+         options->thread_count >= 0 &&
+         options->thread_count <= kMaxThreadCount;
+}
+
+// Draws all the views of the batch on the threads of the render queue
+// and writes them out. The model is loaded from the data directory, the
+// views and the frames are relative to start_path
+internal int LinuxRunBatch(LinuxOptions *options, const char *start_path) {
+  LinuxBatchOutput output = {};
+  output.pattern = options->ppm_path ? options->ppm_path : "frame_%04d.ppm";
+  if (!LinuxIsFramePattern(output.pattern)) {
+    fprintf(stderr, "%s needs exactly one %%d for the frame index\n",
+            output.pattern);
+    return 1;
+  }
+
+  u64 start = PlatformGetWallClock();
+  const char *model_path =
+      options->model_path ? options->model_path : "african_head.model";
+  LoadModelFromFile(&g_model, &g_transient_arena, model_path,
+                    "african_head_diffuse.tga", options->face_order);
+  if (!g_model.is_loaded) {
+    fprintf(stderr, "Couldn't load the model\n");
+    return 1;
+  }
+  if (start_path[0] && chdir(start_path) == -1) return 1;
+
+  RenderView defaults = {};
+  defaults.camera_distance = options->camera_distance;
+  defaults.light_direction = {0, 0, -1.0f};
+  defaults.pitch = options->orbit_pitch;
+
+  RenderView *views = 0;
+  int view_count = 0;
+  if (options->batch_path) {
+    TemporaryMemory temp = BeginTemporaryMemory(&g_transient_arena);
+    FileReadResult file =
+        PlatformReadEntireFile(options->batch_path, &g_transient_arena);
+    if (!file.memory) {
+      fprintf(stderr, "Cannot read %s\n", options->batch_path);
+      return 1;
+    }
+    int error_line;
+    views = ParseRenderViews((char *)file.memory, file.memory_size,
+                             &g_permanent_arena, defaults, &view_count,
+                             &error_line);
+    EndTemporaryMemory(temp);
+    if (view_count == 0 && !error_line) {
+      fprintf(stderr, "%s has no views\n", options->batch_path);
+      return 1;
+    }
+    if (!views && error_line) {
+      fprintf(stderr, "%s:%d: not a view\n", options->batch_path,
+              error_line);
+      return 1;
+    }
+  } else {
+    view_count = options->orbit_frame_count;
+    views = MakeOrbitViews(&g_permanent_arena, view_count, defaults);
+  }
+  if (!views) {
+    fprintf(stderr, "Not enough memory for %d views\n", view_count);
+    return 1;
+  }
+
+  int thread_count = Max(options->thread_count, 1);
+  u64 render_start = PlatformGetWallClock();
+  int drawn_count = RenderBatchViews(views, view_count, options->width,
+                                     options->height, thread_count,
+                                     &g_transient_arena,
+                                     LinuxWriteBatchFrame, &output);
+  r32 render_ms = LinuxGetMsElapsed(render_start, PlatformGetWallClock());
+
+  printf("batch: %d of %d frames, %dx%d, threads: %d, %.3f s, %.1f "
+         "frames per second\n",
+         drawn_count, view_count, options->width, options->height,
+         thread_count, render_ms / 1000.0f,
+         render_ms > 0 ? 1000.0f * drawn_count / render_ms : 0);
+  printf("total with load: %.3f s\n",
+         LinuxGetMsElapsed(start, PlatformGetWallClock()) / 1000.0f);
+  if (output.failed_count > 0) {
+    fprintf(stderr, "Cannot write %d frames to %s\n", output.failed_count,
+            output.pattern);
+    return 1;
+  }
+  if (drawn_count < view_count) {
+    fprintf(stderr, "The frame scratch doesn't fit in the arena\n");
+    return 1;
+  }
+  return 0;
+}
+
+// Times the drawing of every frame, the presents happen alongside
+internal FrameTimes LinuxTimeFrames(FrameLoop *loop, int frame_count,
+                                    r32 *frame_ms) {
+  int drawn_count = 0;
+  u64 run_start = PlatformGetWallClock();
+  for (int frame = 0; frame < frame_count; ++frame) {
+    GameOffscreenBuffer *buffer = BeginFrame(loop);
+    u64 start = PlatformGetWallClock();
+    if (Render(buffer)) drawn_count++;
+    frame_ms[frame] = LinuxGetMsElapsed(start, PlatformGetWallClock());
+    EndFrame(loop);
+  }
+  FinishFrames(loop);
+  r32 run_ms = LinuxGetMsElapsed(run_start, PlatformGetWallClock());
+
+  FrameTimes result;
+  result.first_ms = frame_ms[0];
+  result.fps = 1000.0f * frame_count / run_ms;
+  result.drawn_count = drawn_count;
+
+  // Leave the first frame out of the statistics
+  r32 *timed = frame_ms;
+  int timed_count = frame_count;
+  if (timed_count > 1) {
+    timed++;
+    timed_count--;
+  }
+  qsort(timed, timed_count, sizeof(r32), CompareReal32);
+
+  int p99_index = (int)(0.99f * (timed_count - 1) + 0.5f);
+  result.min_ms = timed[0];
+  result.median_ms = timed[timed_count / 2];
+  result.p99_ms = timed[p99_index];
+
+  return result;
+}
+
+int main(int argc, char **argv) {
+  LinuxOptions options;
+  if (!LinuxParseOptions(argc, argv, &options)) {
+    LinuxPrintUsage(argv[0]);
+    return 1;
+  }
+  if (!options.batch_path && options.orbit_frame_count == 0 &&
+      (options.width > kMaxFrameWidth || options.height > kMaxFrameHeight)) {
+    fprintf(stderr, "Frames are %dx%d at most, except with -b\n",
+            kMaxFrameWidth, kMaxFrameHeight);
+    return 1;
+  }
+
+  // Keep the output path relative to where we were started
+  char start_path[4096];
+  if (!getcwd(start_path, sizeof(start_path))) start_path[0] = '\0';
+
+  // Same for the sink. Streams are opened here, the files of a sequence
+  // are written by the pattern, made absolute
+  LinuxSinkOutput sink_output = {};
+  char sink_pattern[4096];
+  if (options.sink_path && (options.sink_format == FrameSink_RGB24 ||
+                            options.sink_format == FrameSink_BGRA)) {
+    if (strcmp(options.sink_path, "-") == 0) {
+      // The frames take stdout, the report goes to stderr instead
+      fflush(stdout);
+      sink_output.file_handle = dup(STDOUT_FILENO);
+      dup2(STDERR_FILENO, STDOUT_FILENO);
+    } else {
+      sink_output.file_handle =
+          open(options.sink_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    }
+    if (sink_output.file_handle == -1) {
+      fprintf(stderr, "Cannot write to %s\n", options.sink_path);
+      return 1;
+    }
+  } else if (options.sink_path) {
+    if (!LinuxIsFramePattern(options.sink_path)) {
+      fprintf(stderr, "%s needs exactly one %%d for the frame index\n",
+              options.sink_path);
+      return 1;
+    }
+    sink_output.pattern = options.sink_path;
+    if (options.sink_path[0] != '/' && start_path[0]) {
+      snprintf(sink_pattern, sizeof(sink_pattern), "%s/%s", start_path,
+               options.sink_path);
+      sink_output.pattern = sink_pattern;
+    }
+  }
+
+  if (options.data_path && chdir(options.data_path) == -1) {
+    fprintf(stderr, "Cannot change directory to %s\n", options.data_path);
+    return 1;
+  }
+
+  g_render_settings.rasterizer = options.rasterizer;
+  g_render_settings.scalar_only = options.scalar_only;
+  g_render_settings.face_order = options.face_order;
+  g_render_settings.base_level_only = options.base_level_only;
+  g_render_settings.camera_distance = options.camera_distance;
+  g_render_settings.affine_texture = options.affine_texture;
+  g_render_settings.gouraud = options.gouraud;
+  g_render_settings.untextured = options.untextured;
+  g_render_settings.transparency = options.transparency;
+  g_render_settings.shading = options.shading;
+  g_render_settings.wireframe = options.wireframe;
+  g_render_settings.incremental = options.incremental;
+
+  // All the memory there will be, reserved upfront. The pages are only
+  // backed once they are touched
+  GameMemory memory = {};
+  memory.permanent_storage_size = Megabytes(512);
+  memory.transient_storage_size = Megabytes(512);
+  u8 *storage = (u8 *)PlatformAllocateMemory(memory.permanent_storage_size +
+                                             memory.transient_storage_size);
+  memory.permanent_storage = storage;
+  memory.transient_storage = storage + memory.permanent_storage_size;
+  if (!storage || !InitializeRenderer(&memory)) {
+    fprintf(stderr, "Cannot reserve the memory\n");
+    return 1;
+  }
+
+  // Render loads the default model with the first frame, any other one is
+  // loaded upfront so that it isn't replaced by the default
+  if (options.model_path && !options.batch_path &&
+      options.orbit_frame_count == 0) {
+    LoadModelFromFile(&g_model, &g_transient_arena, options.model_path,
+                      "african_head_diffuse.tga", options.face_order);
+    if (!g_model.is_loaded) {
+      fprintf(stderr, "Couldn't load %s\n", options.model_path);
+      return 1;
+    }
+  }
+
+  // Workers are shared by all runs, a run with fewer threads just puts
+  // fewer entries into the queue
+  PlatformWorkQueue render_queue = {};
+  if (options.thread_count > 1) {
+    LinuxMakeQueue(&render_queue, options.thread_count - 1);
+    g_render_queue = &render_queue;
+  }
+  g_render_settings.binned = options.thread_count > 0;
+  g_render_settings.thread_count = options.thread_count;
+
+  if (options.batch_path || options.orbit_frame_count > 0) {
+    return LinuxRunBatch(&options, start_path);
+  }
+
+  // Init backbuffers, frames are only encoded when they are written out
+  {
+    int max_width = kMaxFrameWidth;
+    int max_height = kMaxFrameHeight;
+    PresentFrameCallback *present = 0;
+    if (options.ppm_path) {
+      g_frame_image.rgb =
+          PushArray(&g_permanent_arena, max_width * max_height * 3, u8);
+      present = LinuxPresentFrame;
+    }
+    if (options.sink_path) {
+      local_persist FrameSink frame_sink;
+      if (!StartFrameSink(&frame_sink, &g_permanent_arena, max_width,
+                          max_height, options.sink_format,
+                          LinuxWriteSinkFrame, &sink_output)) {
+        fprintf(stderr, "Not enough memory for the frame sink\n");
+        return 1;
+      }
+      g_frame_sink = &frame_sink;
+      present = LinuxPresentFrame;
+    }
+    StartFrameLoop(&g_frame_loop, &g_permanent_arena, max_width, max_height,
+                   options.target_fps, present, &g_frame_image);
+    SetFrameSize(&g_frame_loop, options.width, options.height);
+  }
+  FrameLoop *loop = &g_frame_loop;
+
+  r32 *frame_ms = PushArray(&g_permanent_arena, options.frame_count, r32);
+  if (!frame_ms || (options.ppm_path && !g_frame_image.rgb)) {
+    fprintf(stderr, "Not enough memory for %d frames\n",
+            options.frame_count);
+    return 1;
+  }
+
+
+  const int kMaxTraceEvents = 1 << 19;
+  DebugCountOverdraw(options.report_profile);
+  if (options.trace_path &&
+      !DebugStartTrace(&g_permanent_arena, kMaxTraceEvents)) {
+    fprintf(stderr, "Cannot trace, the build isn't BUILD_INTERNAL or the "
+                    "events don't fit\n");
+    options.trace_path = 0;
+  }
+
+  if (options.report_scaling && options.thread_count > 1) {
+    // Warm up, so that loading doesn't count towards the first run
+    LinuxTimeFrames(loop, 1, frame_ms);
+
+    printf("%dx%d, %d frames per run\n", loop->width, loop->height,
+           options.frame_count);
+    printf("threads  median ms  min ms  p99 ms  speedup\n");
+
+    r32 single_thread_ms = 0;
+    for (int thread_count = 1; thread_count <= options.thread_count;) {
+      g_render_settings.thread_count = thread_count;
+      FrameTimes times = LinuxTimeFrames(loop, options.frame_count, frame_ms);
+      if (thread_count == 1) single_thread_ms = times.median_ms;
+
+      printf("%7d  %9.3f  %6.3f  %6.3f  %6.2fx\n", thread_count,
+             times.median_ms, times.min_ms, times.p99_ms,
+             single_thread_ms / times.median_ms);
+
+      // Powers of two, and the requested count at the end
+      if (thread_count == options.thread_count) break;
+      thread_count = Min(thread_count * 2, options.thread_count);
+    }
+  } else {
+    FrameTimes times = LinuxTimeFrames(loop, options.frame_count, frame_ms);
+
+    printf("%dx%d, %d frames, %s rasterizer, %s kernel (SIMD width %d), "
+           "%s texture, ",
+           loop->width, loop->height, options.frame_count,
+           options.rasterizer == Rasterizer_Scanline   ? "scanline"
+           : options.rasterizer == Rasterizer_Subpixel ? "subpixel"
+                                                       : "halfspace",
+           options.scalar_only ? "scalar" : "simd", RASTER_SIMD_WIDTH,
+           options.base_level_only ? "base level" : "mipmapped");
+    if (g_render_settings.binned) {
+      printf("binned, threads: %d\n", options.thread_count);
+    } else {
+      printf("not binned\n");
+    }
+    if (options.gouraud || options.untextured || options.transparency > 0 ||
+        options.shading != Shading_Forward) {
+      printf("%s shading, %s, transparency %.2f, %s\n",
+             options.gouraud ? "gouraud" : "flat",
+             options.untextured ? "white" : "textured",
+             options.transparency,
+             options.shading == Shading_Visibility     ? "visibility buffer"
+             : options.shading == Shading_DepthPrepass ? "depth prepass"
+                                                       : "forward");
+    }
+    if (options.camera_distance > 0) {
+      printf("perspective from z = %.2f, %s texture coordinates\n",
+             options.camera_distance,
+             options.affine_texture ? "affine" : "perspective correct");
+    }
+    if (options.wireframe != Wireframe_Off) {
+      printf("wireframe %s, %d edges\n",
+             options.wireframe == Wireframe_Only ? "only" : "overlay",
+             g_model.edge_count);
+    }
+    printf("first frame (with load): %.3f ms\n", times.first_ms);
+    printf("min %.3f ms, median %.3f ms, p99 %.3f ms\n", times.min_ms,
+           times.median_ms, times.p99_ms);
+    if (options.incremental) {
+      printf("%d of %d frames drawn, the rest unchanged\n",
+             times.drawn_count, options.frame_count);
+    }
+    printf("%.1f frames per second", times.fps);
+    if (options.target_fps) printf(", paced at %d", options.target_fps);
+    printf("\n");
+  }
+
+  if (g_frame_sink) {
+    FinishFrameSink(g_frame_sink);
+    printf("sink: %u frames, %.1f MB, the presenter waited %.3f ms for "
+           "the writer\n",
+           g_frame_sink->frames_written,
+           g_frame_sink->bytes_written / (1024.0 * 1024.0),
+           g_frame_sink->wait_ns / 1000000.0);
+    if (g_frame_sink->failed_count > 0) {
+      fprintf(stderr, "Cannot write %d frames to %s\n",
+              g_frame_sink->failed_count, options.sink_path);
+      return 1;
+    }
+  }
+
+  if (!g_model.is_loaded) {
+    fprintf(stderr, "Couldn't load the model\n");
+    return 1;
+  }
+  printf("model: %d vertices, %d faces, ACMR %.3f in the file, %.3f drawn "
+         "(FIFO of %d)\n",
+         g_model.vert_count, g_model.face_count, g_model.file_acmr,
+         g_model.acmr, kVertexCacheSize);
+  if (options.report_profile) DebugPrintReport();
+
+  GameOffscreenBuffer shadow_map = {};
+  if (options.shadow_path) {
+    const int kShadowMapSize = 1024;
+    v3 light_direction = Normalize({0, 0, -1.0f});  // same as Render
+    if (!AllocateShadowMap(&shadow_map, &g_permanent_arena,
+                           kShadowMapSize)) {
+      fprintf(stderr, "Not enough memory for the shadow map\n");
+      return 1;
+    }
+    for (int i = 0; i < options.frame_count; ++i) {
+      u64 start = PlatformGetWallClock();
+      RenderShadowMap(&shadow_map, &g_transient_arena, light_direction);
+      frame_ms[i] = LinuxGetMsElapsed(start, PlatformGetWallClock());
+    }
+    qsort(frame_ms, options.frame_count, sizeof(r32), CompareReal32);
+    printf("shadow map %dx%d: min %.3f ms, median %.3f ms\n",
+           kShadowMapSize, kShadowMapSize, frame_ms[0],
+           frame_ms[options.frame_count / 2]);
+  }
+
+  if (start_path[0] && chdir(start_path) == -1) return 1;
+  if (options.ppm_path && !LinuxWritePPM(&g_frame_image, options.ppm_path)) {
+    fprintf(stderr, "Cannot write %s\n", options.ppm_path);
+    return 1;
+  }
+  if (options.shadow_path &&
+      !LinuxWriteDepthPGM(&shadow_map, options.shadow_path)) {
+    fprintf(stderr, "Cannot write %s\n", options.shadow_path);
+    return 1;
+  }
+  if (options.trace_path &&
+      !DebugWriteTrace(&g_transient_arena, options.trace_path)) {
+    fprintf(stderr, "Cannot write %s\n", options.trace_path);
+    return 1;
+  }
+
+  return 0;
+}
@@ -0,0 +1,67 @@
+#ifndef LINUX_RENDERER_H
+#define LINUX_RENDERER_H
+
+struct LinuxOptions {
+  int width;
+  int height;
+  int frame_count;
+  const char *data_path;  // directory with the model and texture
+  const char *model_path;  // in the data directory, 0 for the default
+  const char *ppm_path;   // where to dump the last frame, if anywhere
+  int target_fps;         // 0 doesn't pace the frames
+  RasterizerType rasterizer;
+  bool32 scalar_only;
+  int thread_count;       // 0 draws without binning
+  bool32 report_scaling;  // time every thread count from 1 to thread_count
+  FaceOrder face_order;
+  bool32 base_level_only;  // don't use the texture mipmaps
+  r32 camera_distance;     // 0 for the orthographic view
+  bool32 affine_texture;
+  bool32 gouraud;
+  bool32 untextured;
+  r32 transparency;
+  ShadingMode shading;
+  WireframeMode wireframe;
+  bool32 incremental;  // skip the frames that haven't changed
+  bool32 report_profile;   // timed blocks and pipeline counters
+  const char *trace_path;  // Chrome trace of the timed blocks
+  const char *shadow_path;  // where to dump the shadow map, if anywhere
+
+  // Batch mode, draws the views of the file or an orbit around the model
+  // instead of timing frames, and writes them all to ppm_path
+  const char *batch_path;
+  int orbit_frame_count;
+  r32 orbit_pitch;
+
+  // Every presented frame goes to the sink, if there is one. - is stdout
+  const char *sink_path;
+  FrameSinkFormat sink_format;
+};
+
+struct FrameTimes {
+  r32 first_ms;  // includes loading on the first run
+  r32 min_ms;
+  r32 median_ms;
+  r32 p99_ms;
+  r32 fps;  // over the whole run, with the waits and the pacing
+  int drawn_count;  // frames that weren't skipped
+};
+
+// Last presented frame as packed RGB
+struct LinuxFrameImage {
+  u8 *rgb;
+  int width;
+  int height;
+
+  // Where it came from, a skipped frame doesn't change the buffer
+  GameOffscreenBuffer *buffer;
+  u32 generation;
+};
+
+// Where the frame sink writes, a stream or a file per frame
+struct LinuxSinkOutput {
+  int file_handle;      // for the raw formats
+  const char *pattern;  // printf pattern for the frame index otherwise
+};
+
+#endif
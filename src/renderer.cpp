@@ -2,59 +2,32 @@
 #define RENDERER_CPP
 
 #include <stdio.h>
+#include <string.h>
 #include <limits.h>
 
 global Model g_model;
-
-inline void SetPixel(int x, int y, u32 color) {
-  // Point 0, 0 is in the left bottom corner
-  if (x < 0 || y < 0 || x >= g_game_backbuffer.width ||
-      y >= g_game_backbuffer.height)
-    return;
-
-  int pitch = g_game_backbuffer.width * g_game_backbuffer.bytes_per_pixel;
-  u8 *row = (u8 *)g_game_backbuffer.memory +
-            (g_game_backbuffer.height - 1) * pitch - pitch * y +
-            x * g_game_backbuffer.bytes_per_pixel;
-  u32 *Pixel = (u32 *)row;
-  *Pixel = color;
-}
-
-internal void DebugLine(int x0, int y0, int x1, int y1, u32 color) {
-  bool32 steep = false;
-  if (Abs(x1 - x0) < Abs(y1 - y0)) {
-    steep = true;
-    swap_int(&x0, &y0);
-    swap_int(&x1, &y1);
-  }
-  if (x0 > x1) {
-    swap_int(&x0, &x1);
-    swap_int(&y0, &y1);
-  }
-
-  int dx = x1 - x0;
-  int dy = y1 - y0;
-  int derror2 = Abs(dy) * 2;
-  int error2 = 0;
-  int y = y0;
-
-  for (int x = x0; x <= x1; x++) {
-    if (steep)
-      SetPixel(y, x, color);
-    else
-      SetPixel(x, y, color);
-
-    error2 += derror2;
-
-    if (error2 > 1) {
-      y += (y1 > y0 ? 1 : -1);
-      error2 -= 2 * dx;
-    }
-  }
-}
-
-internal void Triangle(v3i *p, v2i *uv, r32 intensity, TGAImage *texture,
-                       int *z_buffer) {
+global RenderSettings g_render_settings;
+
+// See InitializeRenderer
+global MemoryArena g_permanent_arena;
+global MemoryArena g_transient_arena;
+
+#include "renderer_depth.cpp"
+#include "renderer_debug.cpp"
+#include "renderer_texture.cpp"
+#include "renderer_raster.cpp"
+#include "renderer_visibility.cpp"
+#include "renderer_tiles.cpp"
+#include "renderer_optimize.cpp"
+#include "renderer_model.cpp"
+#include "renderer_vertex.cpp"
+#include "renderer_wireframe.cpp"
+#include "renderer_sink.cpp"
+
+internal void Triangle(v3i *p, v2i *uv, r32 intensity, Texture *texture,
+                       GameOffscreenBuffer *buffer) {
+  TIMED_BLOCK(ScanlineTriangle);
+  DEBUG_COUNT(FacesRasterized, 1);
   v3i *p0 = &p[0];
   v3i *p1 = &p[1];
   v3i *p2 = &p[2];
@@ -63,20 +36,37 @@ internal void Triangle(v3i *p, v2i *uv, r32 intensity, TGAImage *texture,
   v2i *uv1 = &uv[1];
   v2i *uv2 = &uv[2];
 
-  // Sort points by y
-  if (p0->y > p1->y) swap_pointers(&p0, &p1);
-  if (p1->y > p2->y) swap_pointers(&p1, &p2);
-  if (p0->y > p1->y) swap_pointers(&p0, &p1);
+  // Sort points by y, texture coordinates follow their points
+  if (p0->y > p1->y) {
+    swap_pointers(&p0, &p1);
+    swap_pointers(&uv0, &uv1);
+  }
+  if (p1->y > p2->y) {
+    swap_pointers(&p1, &p2);
+    swap_pointers(&uv1, &uv2);
+  }
+  if (p0->y > p1->y) {
+    swap_pointers(&p0, &p1);
+    swap_pointers(&uv0, &uv1);
+  }
 
-  if (uv0->y > uv1->y) swap_pointers(&uv0, &uv1);
-  if (uv1->y > uv2->y) swap_pointers(&uv1, &uv2);
-  if (uv0->y > uv1->y) swap_pointers(&uv0, &uv1);
+  // Texture level for the whole triangle, texture coordinates are shifted
+  // down to it
+  v2i duv1 = *uv1 - *uv0;
+  v2i duv2 = *uv2 - *uv0;
+  r32 texel_area = Abs((r32)duv1.x * duv2.y - (r32)duv1.y * duv2.x);
+  r32 pixel_area = Abs((r32)(p1->x - p0->x) * (p2->y - p0->y) -
+                       (r32)(p1->y - p0->y) * (p2->x - p0->x));
+  int level_index = SelectTextureLevel(texture, texel_area, pixel_area);
+  TextureLevel *level = &texture->levels[level_index];
 
   v3i long_side = *p2 - *p0;
   int total_height = long_side.y;
   int segment_height = 0;
+  RasterCounts counts = {};
 
-  for (int y = p0->y; y <= p2->y; ++y) {
+  int y_end = Min(p2->y, buffer->height - 1);
+  for (int y = Max(p0->y, 0); y <= y_end; ++y) {
     bool32 top_half = (y > p1->y) || (p0->y == p1->y);
     v3i short_side = top_half ? (*p2 - *p1) : (*p1 - *p0);
     int y0 = (top_half ? p1->y : p0->y);
@@ -102,173 +92,379 @@ internal void Triangle(v3i *p, v2i *uv, r32 intensity, TGAImage *texture,
       int x0 = a.x;
       int x1 = b.x;
       if (x0 < 0) x0 = 0;
-      if (x1 >= g_game_backbuffer.width) x1 = g_game_backbuffer.width - 1;
-      if (y < 0 || y >= g_game_backbuffer.height) continue;
+      if (x1 >= buffer->width) x1 = buffer->width - 1;
+      if (y < 0 || y >= buffer->height) continue;
 
-      int pitch = g_game_backbuffer.width * g_game_backbuffer.bytes_per_pixel;
-      u8 *row = (u8 *)g_game_backbuffer.memory +
-                (g_game_backbuffer.height - 1) * pitch - pitch * y +
-                x0 * g_game_backbuffer.bytes_per_pixel;
+      int pitch = buffer->width * buffer->bytes_per_pixel;
+      u8 *row = (u8 *)buffer->memory + (buffer->height - 1) * pitch -
+                pitch * y + x0 * buffer->bytes_per_pixel;
       u32 *Pixel = (u32 *)row;
 
+      // Attributes step along the span with adds, the rounding 0.5 is
+      // added in upfront. A span of one pixel takes the values at b
+      r32 z = (r32)b.z + 0.5f;
+      r32 u = (r32)uv_b.x + 0.5f;
+      r32 v = (r32)uv_b.y + 0.5f;
+      r32 dz_dx = 0;
+      r32 du_dx = 0;
+      r32 dv_dx = 0;
+      if (b.x != a.x) {
+        r32 inv_dx = 1.0f / (b.x - a.x);
+        dz_dx = (b.z - a.z) * inv_dx;
+        du_dx = (uv_b.x - uv_a.x) * inv_dx;
+        dv_dx = (uv_b.y - uv_a.y) * inv_dx;
+        r32 skip = (r32)(x0 - a.x);
+        z = a.z + 0.5f + skip * dz_dx;
+        u = uv_a.x + 0.5f + skip * du_dx;
+        v = uv_a.y + 0.5f + skip * dv_dx;
+      }
+
+      int *depth = buffer->z_buffer + y * buffer->width + x0;
+      DEBUG_ADD(counts.tested, Max(x1 - x0 + 1, 0));
       for (int x = x0; x <= x1; ++x) {
-        r32 share =
-            (b.x == a.x) ? 1.0f : static_cast<r32>(x - a.x) / (b.x - a.x);
-        v3i result = a + share * (b - a);
-        v2i uv_result = uv_a + share * (uv_b - uv_a);
-
-        int index = result.y * g_game_backbuffer.width + result.x;
-        if (z_buffer[index] < result.z) {
-          z_buffer[index] = result.z;
-          TGAColor color = texture->get(uv_result.x, uv_result.y);
-          *Pixel = (u32)(color.r * intensity) << 16 |
-                   (u32)(color.g * intensity) << 8 | (u32)(color.b * intensity);
+        int pixel_z = (int)z;
+        if (*depth < pixel_z) {
+          DEBUG_ADD(counts.passed, 1);
+          *depth = pixel_z;
+          u32 texel = 0x00FFFFFF;  // white without a texture
+          if (texture->level_count > 0) {
+            texel = *GetTexel(level, (int)u >> level_index,
+                              (int)v >> level_index);
+          }
+          u32 r = (texel >> 16) & 0xFF;
+          u32 g = (texel >> 8) & 0xFF;
+          u32 b = texel & 0xFF;
+          *Pixel = (u32)(r * intensity) << 16 | (u32)(g * intensity) << 8 |
+                   (u32)(b * intensity);
         }
+        z += dz_dx;
+        u += du_dx;
+        v += dv_dx;
+        depth++;
         Pixel++;
       }
     }
   }
+
+  DEBUG_COUNT(PixelsTested, counts.tested);
+  DEBUG_COUNT(PixelsPassed, counts.passed);
+  DEBUG_COUNT(PixelsShaded, counts.passed);
 }
 
-internal void DebugTriangle(v2i *p0, v2i *p1, v2i *p2, u32 color) {
-  DebugLine(p0->x, p0->y, p1->x, p1->y, color);
-  DebugLine(p0->x, p0->y, p2->x, p2->y, color);
-  DebugLine(p1->x, p1->y, p2->x, p2->y, color);
+internal void DebugTriangle(GameOffscreenBuffer *buffer, v2i *p0, v2i *p1,
+                           v2i *p2, u32 color) {
+  DebugLine(buffer, p0->x, p0->y, p1->x, p1->y, color);
+  DebugLine(buffer, p0->x, p0->y, p2->x, p2->y, color);
+  DebugLine(buffer, p1->x, p1->y, p2->x, p2->y, color);
 }
 
-internal void LoadModelFromFile(char *filename, char *texture_filename) {
-  // Load texture
-  g_model.texture = (TGAImage *)new TGAImage();
-  g_model.texture->read_tga_file(texture_filename);
-  g_model.texture->flip_vertically();
+inline u32 GetGrayColor(r32 intensity) {
+  u32 Grey = static_cast<u32>(0xFF * intensity);
+  u32 result = Grey << 16 | Grey << 8 | Grey;
+  return result;
+}
 
-  // Load model
-  {
-    FILE *model_file;
-    fopen_s(&model_file, filename, "rb");
-
-    const int kMaxChars = 200;
-    char buffer[kMaxChars];
-    char line_type[3];
-
-    // Count vertices and faces
-    while (fgets(buffer, kMaxChars, model_file)) {
-      sscanf_s(buffer, "%s ", line_type, 3);
-      if (strcmp(line_type, "v") == 0) {
-        g_model.vert_count++;
-      } else if (strcmp(line_type, "f") == 0) {
-        g_model.face_count++;
-      } else if (strcmp(line_type, "vt") == 0) {
-        g_model.tc_count++;
+// True if every face of the meshlet faces away from the light, or is off
+// the screen
+internal bool32 IsMeshletCulled(Meshlet *meshlet, v3 light_direction,
+                                ViewRotation *rotation, r32 camera_distance,
+                                int width, int height) {
+  // Leaves room for the rounding of the cone
+  const r32 kConeEpsilon = 1e-3f;
+  if (DotProduct(meshlet->cone_axis, light_direction) <=
+      -meshlet->cone_sin - kConeEpsilon) {
+    return true;
+  }
+
+  // Range of 1/w over the bounding sphere, see TransformVertices
+  v3 center = RotateToView(rotation, meshlet->center);
+  r32 radius = meshlet->radius;
+  r32 inv_w_min = 1.0f;
+  r32 inv_w_max = 1.0f;
+  if (camera_distance > 0) {
+    if (center.z + radius >= camera_distance) return false;
+    inv_w_min = 1.0f / (1.0f - (center.z - radius) / camera_distance);
+    inv_w_max = 1.0f / (1.0f - (center.z + radius) / camera_distance);
+  }
+
+  // Projected bounding box of the sphere's box in pixels, with a pixel to
+  // spare for the rounding
+  r32 scale = height / 2.0f;
+  r32 min_x = Min((center.x - radius) * inv_w_min,
+                  (center.x - radius) * inv_w_max);
+  r32 min_y = Min((center.y - radius) * inv_w_min,
+                  (center.y - radius) * inv_w_max);
+  r32 max_x = Max((center.x + radius) * inv_w_min,
+                  (center.x + radius) * inv_w_max);
+  r32 max_y = Max((center.y + radius) * inv_w_min,
+                  (center.y + radius) * inv_w_max);
+  bool32 result = (max_x + 1.0f) * scale < -2.0f ||
+                  (max_y + 1.0f) * scale < -2.0f ||
+                  (min_x + 1.0f) * scale - 1.0f > width ||
+                  (min_y + 1.0f) * scale - 1.0f > height;
+  return result;
+}
+
+// Looks up the face corners in the screen vertices. Returns false if the
+// face is facing away from the light, or reaches behind the near plane
+internal bool32 AssembleFace(int face_index, v3 light_direction,
+                             ScreenVertices *screen, PipelineState *state,
+                             AssembledFace *result) {
+  result->intensity =
+      DotProduct(g_model.face_normals[face_index], light_direction);
+  if (result->intensity <= 0) return false;
+
+  Face *face = &g_model.faces[face_index];
+  for (int j = 0; j < 3; ++j) {
+    result->p[j] = GetScreenVertex(screen, face->v[j] - 1);
+    result->inv_w[j] = screen->inv_w[face->v[j] - 1];
+    if (result->inv_w[j] <= 0) return false;
+
+    // Corners without texture coordinates, v and v//vn, take the middle
+    // of the texture
+    v2 uv = {0.5f, 0.5f};
+    if (face->uvs[j]) uv = g_model.texture_coords[face->uvs[j] - 1];
+    result->uv[j] = GetTexelCoords(uv, &g_model.diffuse);
+  }
+
+  if (state->flags & RasterState_Gouraud) {
+    for (int j = 0; j < 3; ++j) {
+      // Faces without vertex normals are shaded flat. The vertex normals
+      // point out of the model, the face normals into it
+      r32 intensity = result->intensity;
+      if (face->normals[j]) {
+        intensity = -DotProduct(g_model.normals[face->normals[j] - 1],
+                                light_direction);
       }
+      result->vertex_intensity[j] = Min(Max(intensity, 0.0f), 1.0f);
     }
+  }
+
+  return true;
+}
+
+// Returns false if the bins don't fit in the arena, nothing is drawn then
+internal bool32 RenderBinned(GameOffscreenBuffer *buffer, MemoryArena *arena,
+                             ScreenVertices *screen, v3 light_direction,
+                             ViewRotation *rotation, r32 camera_distance,
+                             PipelineState *state, ShadingMode shading,
+                             int thread_count) {
+  TileBins bins = {};
+  if (!ResetTileBins(&bins, arena, buffer, g_model.face_count)) return false;
 
-    // Allocate space for data
-    g_model.vertices = static_cast<v3 *>(VirtualAlloc(
-        0, sizeof(v3) * g_model.vert_count, MEM_COMMIT, PAGE_READWRITE));
-    g_model.faces = static_cast<Face *>(VirtualAlloc(
-        0, sizeof(Face) * g_model.face_count, MEM_COMMIT, PAGE_READWRITE));
-    g_model.texture_coords = static_cast<v2i *>(VirtualAlloc(
-        0, sizeof(v2i) * g_model.tc_count, MEM_COMMIT, PAGE_READWRITE));
-    v3 *v = g_model.vertices;
-    Face *f = g_model.faces;
-    v2i *vt = g_model.texture_coords;
-
-    // Fill model data
-    fseek(model_file, 0, SEEK_SET);
-    while (fgets(buffer, kMaxChars, model_file)) {
-      sscanf_s(buffer, "%s ", line_type, 3);
-      if (strcmp(line_type, "v") == 0) {
-        // Vertices
-        sscanf_s(buffer, "v %f %f %f", &v->x, &v->y, &v->z);
-        v++;
-      } else if (strcmp(line_type, "f") == 0) {
-        // Faces
-        char v1[30], v2[30], v3[30];  // vertex data
-        sscanf_s(buffer, "f %s %s %s", v1, 30, v2, 30, v3, 30);
-        sscanf_s(v1, "%d/%d", &f->v[0], &f->uvs[0]);
-        sscanf_s(v2, "%d/%d", &f->v[1], &f->uvs[1]);
-        sscanf_s(v3, "%d/%d", &f->v[2], &f->uvs[2]);
-        f++;
-      } else if (strcmp(line_type, "vt") == 0) {
-        // Texture coordinates
-        r32 x, y;
-        sscanf_s(buffer, "vt %f %f", &x, &y);
-        vt->x = (int)(x * g_model.texture->width);
-        vt->y = (int)(y * g_model.texture->height);
-        vt++;
+  // Set up and bin every visible face
+  {
+    TIMED_BLOCK(SetupTriangles);
+    for (int m = 0; m < g_model.meshlet_count; ++m) {
+      Meshlet *meshlet = &g_model.meshlets[m];
+      if (IsMeshletCulled(meshlet, light_direction, rotation,
+                          camera_distance, buffer->width, buffer->height))
+        continue;
+
+      int end_face = meshlet->first_face + meshlet->face_count;
+      for (int i = meshlet->first_face; i < end_face; ++i) {
+        AssembledFace face;
+        if (!AssembleFace(i, light_direction, screen, state, &face)) continue;
+
+        HalfSpaceTriangle *tri = &bins.triangles[bins.triangle_count];
+        if (SetupHalfSpaceTriangle(tri, &face, state, buffer->width,
+                                   buffer->height)) {
+          tri->id = bins.triangle_count++;
+        }
       }
     }
-
-    fclose(model_file);
-    g_model.is_loaded = true;
   }
+  DEBUG_COUNT(FacesRasterized, bins.triangle_count);
+  if (!BinTriangles(&bins, arena)) return false;
+
+  DrawTiles(&bins, buffer, thread_count, shading, state->flags);
+  return true;
 }
 
-inline u32 GetGrayColor(r32 intensity) {
-  u32 Grey = static_cast<u32>(0xFF * intensity);
-  u32 result = Grey << 16 | Grey << 8 | Grey;
+// The model gets a fixed part of the permanent storage, which every load
+// of a model reuses
+const u64 kModelArenaSize = Megabytes(256);
+
+// Sets up the arenas on the memory the platform layer reserved. The
+// transient arena is scratch that is free again at the end of every load
+// and every frame. Returns false if the permanent storage is too small
+internal bool32 InitializeRenderer(GameMemory *memory) {
+  InitializeArena(&g_permanent_arena, memory->permanent_storage,
+                  memory->permanent_storage_size);
+  InitializeArena(&g_transient_arena, memory->transient_storage,
+                  memory->transient_storage_size);
+  bool32 result = SubArena(&g_model.arena, &g_permanent_arena, kModelArenaSize);
   return result;
 }
 
-internal void Render() {
-  v3 light_direction = {0, 0, -1.0f};
-  light_direction = Normalize(light_direction);
-  v3i p[3];
-  int height = g_game_backbuffer.height;
-  int width = g_game_backbuffer.width;
-  if (!g_model.is_loaded)
-    LoadModelFromFile("african_head.model", "african_head_diffuse.tga");
-  if (!g_game_backbuffer.is_initialized) {
-    g_game_backbuffer.z_buffer = (int *)VirtualAlloc(
-        0, 4 * width * height * sizeof(int), MEM_COMMIT, PAGE_READWRITE);
-    for (int i = 0; i < width * height; ++i) {
-      g_game_backbuffer.z_buffer[i] = INT_MIN;
+// Draws the model as seen from the view. The scratch is temporary memory
+// on the arena, and the tiles are drawn on thread_count threads. Nothing
+// else is written, so with a thread_count of 1 frames can be drawn
+// concurrently, each into its own buffer with its own arena. Returns false
+// if the scratch doesn't fit
+internal bool32 DrawView(GameOffscreenBuffer *buffer, MemoryArena *arena,
+                         RenderView *view, int thread_count) {
+  int height = buffer->height;
+  int width = buffer->width;
+
+  // The model is turned into the view and the light the other way into
+  // the model, so the normals and the meshlet cones stay as they are
+  ViewRotation rotation = GetViewRotation(view->yaw, view->pitch);
+  v3 light_direction =
+      RotateToModel(&rotation, Normalize(view->light_direction));
+  bool32 is_turned = view->yaw != 0 || view->pitch != 0;
+
+  // Vertex stage
+  int subpixel_bits =
+      g_render_settings.rasterizer == Rasterizer_Subpixel ? kSubpixelBits : 0;
+  r32 camera_distance = view->camera_distance;
+  TemporaryMemory frame_memory = BeginTemporaryMemory(arena);
+  v3 *vertices = g_model.vertices;
+  if (is_turned) {
+    vertices = PushArray(arena, g_model.vert_count, v3);
+    if (vertices) {
+      RotateVertices(&rotation, g_model.vertices, vertices,
+                     g_model.vert_count);
     }
-    g_game_backbuffer.is_initialized = true;
+  }
+  ScreenVertices screen = {};
+  if (!vertices ||
+      !TransformVertices(&screen, arena, vertices, g_model.vert_count,
+                         height, subpixel_bits, camera_distance)) {
+    EndTemporaryMemory(frame_memory);
+    return false;
   }
 
-  // Draw model
-  for (int i = 0; i < g_model.face_count; ++i) {
-    Face *face = &g_model.faces[i];
+  PipelineState state = {};
+  state.flags = RasterState_DepthTest | RasterState_DepthWrite;
+  if (!g_render_settings.untextured && g_model.diffuse.level_count > 0) {
+    state.flags |= RasterState_Textured;
+  }
+  if (g_render_settings.gouraud) state.flags |= RasterState_Gouraud;
+  if (g_render_settings.transparency > 0) state.flags |= RasterState_Blend;
+  if (camera_distance > 0 && !g_render_settings.affine_texture) {
+    state.flags |= RasterState_Perspective;
+  }
+  state.color = 0x00FFFFFF;
+  state.alpha = 1.0f - g_render_settings.transparency;
+  state.texture = &g_model.diffuse;
+  state.subpixel_bits = subpixel_bits;
+
+  DEBUG_COUNT(FacesSubmitted, g_model.face_count);
+  ClearBuffer(buffer, 0);
+  if (g_render_settings.rasterizer == Rasterizer_Scanline) {
+    // The scanline path doesn't know about tiles, clear them all upfront
+    Rect2i rect = {0, 0, width - 1, height - 1};
+    PrepareDepthTiles(buffer, rect);
+  }
 
-    v3 vert[3];
-    // Look up actual coordinates from the model
-    for (int j = 0; j < 3; ++j) {
-      vert[j] = g_model.vertices[face->v[j] - 1];
-    }
+  // The other modes need all the triangles, which only the binned path
+  // keeps. Blending shades every layer, so it's always forward
+  ShadingMode shading = g_render_settings.shading;
+  if (state.flags & RasterState_Blend) shading = Shading_Forward;
 
-    v3 normal = Normalize(CrossProduct(vert[2] - vert[0], vert[1] - vert[0]));
-    r32 intensity = DotProduct(normal, light_direction);
-    if (intensity <= 0) continue;
+  // Draw model
+  bool32 result = true;
+  if (g_render_settings.wireframe == Wireframe_Only) {
+    // Only the lines
+  } else if (g_render_settings.rasterizer != Rasterizer_Scanline &&
+             (g_render_settings.binned || shading != Shading_Forward)) {
+    result = RenderBinned(buffer, arena, &screen, light_direction, &rotation,
+                          camera_distance, &state, shading, thread_count);
+  } else {
+    for (int m = 0; m < g_model.meshlet_count; ++m) {
+      Meshlet *meshlet = &g_model.meshlets[m];
+      if (IsMeshletCulled(meshlet, light_direction, &rotation,
+                          camera_distance, width, height))
+        continue;
+
+      int end_face = meshlet->first_face + meshlet->face_count;
+      for (int i = meshlet->first_face; i < end_face; ++i) {
+        AssembledFace face;
+        if (!AssembleFace(i, light_direction, &screen, &state, &face)) {
+          continue;
+        }
 
-    // Adjust the vertices to fit the window size
-    for (int j = 0; j < 3; ++j) {
-      for (int k = 0; k < 3; ++k) {
-        p[j].e[k] = static_cast<int>((vert[j].e[k] + 1.0f) * height / 2.0f);
+        if (g_render_settings.rasterizer == Rasterizer_Scanline) {
+          Triangle(face.p, face.uv, face.intensity, &g_model.diffuse,
+                   buffer);
+        } else {
+          TriangleHalfSpace(&face, &state, buffer);
+        }
       }
     }
+  }
 
-    v2i uv[3];
-    for (int j = 0; j < 3; ++j) {
-      uv[j] = g_model.texture_coords[face->uvs[j] - 1];
-    }
-
-    Triangle(p, uv, intensity, g_model.texture, g_game_backbuffer.z_buffer);
+  {
+    TIMED_BLOCK(ResolveBuffer);
+    ResolveBuffer(buffer);
   }
+  if (g_render_settings.wireframe != Wireframe_Off) {
+    DrawWireframe(buffer, &screen, g_model.edges, g_model.edge_count,
+                  subpixel_bits, kWireframeColor, thread_count);
+  }
+  DebugEndFrame(buffer);
+
+  EndTemporaryMemory(frame_memory);
 
   // u32 color = 0x00AAAAAA;
   // v2i p0[3] = {{10, 70}, {50, 160}, {70, 100}};
   // v2i p1[3] = {{180, 50}, {150, 1}, {70, 180}};
   // v2i p2[3] = {{180, 150}, {120, 160}, {130, 180}};
 
-  // DebugTriangle(&p0[0], &p0[1], &p0[2], 0x00FF0000);
-  // DebugTriangle(&p1[0], &p1[1], &p1[2], 0x00FF0000);
-  // DebugTriangle(&p2[0], &p2[1], &p2[2], 0x00FF0000);
+  // DebugTriangle(buffer, &p0[0], &p0[1], &p0[2], 0x00FF0000);
+  // DebugTriangle(buffer, &p1[0], &p1[1], &p1[2], 0x00FF0000);
+  // DebugTriangle(buffer, &p2[0], &p2[1], &p2[2], 0x00FF0000);
 
   // Triangle(&p0[0], &p0[1], &p0[2], color);
   // Triangle(&p1[0], &p1[1], &p1[2], color);
   // Triangle(&p2[0], &p2[1], &p2[2], color);
+
+  return result;
 }
 
+// The view of the interactive renderer, along the z axis
+inline RenderView GetDefaultView() {
+  RenderView result = {};
+  result.camera_distance = g_render_settings.camera_distance;
+  result.light_direction = {0, 0, -1.0f};
+  return result;
+}
+
+// Returns false if nothing was drawn, because the buffer already holds
+// the frame, there is nothing to draw into or the frame scratch doesn't
+// fit in the transient arena
+internal bool32 Render(GameOffscreenBuffer *buffer) {
+  TIMED_BLOCK(Render);
+  RenderView view = GetDefaultView();
+  if (!g_model.is_loaded)
+    LoadModelFromFile(&g_model, &g_transient_arena, "african_head.model",
+                      "african_head_diffuse.tga",
+                      g_render_settings.face_order);
+  if (!buffer->z_buffer) return false;  // nothing to draw into
+
+  SceneState scene = {};
+  scene.model_version = g_model.version;
+  scene.light_direction = Normalize(view.light_direction);
+  scene.settings = g_render_settings;
+  scene.width = buffer->width;
+  scene.height = buffer->height;
+  if (g_render_settings.incremental && buffer->scene.model_version &&
+      memcmp(&scene, &buffer->scene, sizeof(scene)) == 0) {
+    return false;
+  }
+
+  bool32 result = DrawView(buffer, &g_transient_arena, &view,
+                           g_render_settings.thread_count);
+  buffer->scene = scene;
+  if (!result) buffer->scene.model_version = 0;  // drawn again next time
+  CheckArena(&g_transient_arena);
+  return result;
+}
+
+// These call AssembleFace, Render or DrawView, so they come last
+#include "renderer_shadow.cpp"
+#include "renderer_frames.cpp"
+#include "renderer_batch.cpp"
+
 #endif  // RENDERER_CPP
\ No newline at end of file
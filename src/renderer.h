@@ -3,16 +3,19 @@
 
 #include "renderer_platform.h"
 #include "renderer_math.h"
+#include "renderer_memory.h"
 
-struct GameOffscreenBuffer {
-  void *memory;
-  int width;
-  int height;
-  int bytes_per_pixel;
-  int max_width;  // We'll only allocate this much
-  int max_height;
-  int *z_buffer;
-  bool32 is_initialized;
+// Range of the depth values in an 8x8 block of the z-buffer
+struct DepthBlock {
+  int z_min;
+  int z_max;
+};
+
+// Coarse depth and clear state of a 64x64 tile
+struct DepthTile {
+  int z_min;
+  u32 generation;    // buffer generation the tile was last cleared in
+  bool32 has_color;  // color may differ from the clear color
 };
 
 struct FileReadResult {
@@ -20,12 +23,65 @@ struct FileReadResult {
   u64 memory_size;
 };
 
+// Indices are 1-based, 0 when the model doesn't have them
 struct Face {
   // Three vertices
   int v[3];
 
   // Texture coordinates
   int uvs[3];
+
+  // Vertex normals
+  int normals[3];
+};
+
+// 0x00RRGGBB texels in 4x4 tiles, see renderer_texture.cpp
+struct TextureLevel {
+  u32 *texels;
+  int width;
+  int height;
+  int tiles_x;  // tiles in a row
+};
+
+const int kMaxTextureLevels = 16;
+
+// Mipmapped copy of a TGAImage
+struct Texture {
+  int width;  // of level 0
+  int height;
+  TextureLevel levels[kMaxTextureLevels];
+  int level_count;
+
+  u32 *memory;  // all levels
+  u64 memory_size;
+};
+
+// Consecutive faces that are culled together, see BuildMeshlets
+struct Meshlet {
+  int first_face;
+  int face_count;
+
+  // Bounding sphere of the vertices
+  v3 center;
+  r32 radius;
+
+  // All face normals are within the angle θ of cone_axis. Facing away
+  // from L everywhere when Dot(cone_axis, L) <= -cone_sin, which never
+  // happens when cone_sin > 1
+  v3 cone_axis;
+  r32 cone_sin;
+};
+
+// Indices into Model::vertices, 0-based unlike the faces, v[0] < v[1]
+struct Edge {
+  int v[2];
+};
+
+// Order the faces are drawn in, see renderer_optimize.cpp
+enum FaceOrder {
+  FaceOrder_File,         // as in the model file
+  FaceOrder_Locality,     // for vertex cache locality
+  FaceOrder_FrontToBack,  // locality within clusters, clusters front to back
 };
 
 struct Model {
@@ -37,8 +93,136 @@ struct Model {
   Face *faces;
   int face_count;
 
-  v2i *texture_coords;
+  v2 *texture_coords;  // normalized, see GetTexelCoords
   int tc_count;
 
-  TGAImage *texture;
+  v3 *normals;
+  int normal_count;
+
+  v3 *face_normals;  // one per face
+  Meshlet *meshlets;
+  int meshlet_count;
+
+  Edge *edges;  // every edge of the faces once, see BuildEdges
+  int edge_count;
+
+  // Average vertex cache miss ratio in the file and in the order used
+  FaceOrder face_order;
+  r32 file_acmr;
+  r32 acmr;
+
+  Texture diffuse;
+
+  // The arrays above point into this when the model came from its cache,
+  // or else into the arena
+  FileReadResult cache_file;
+  MemoryArena arena;  // cleared by UnloadModel
+
+  u32 version;  // bumped by every load
+};
+
+enum RasterizerType {
+  Rasterizer_HalfSpace,
+  Rasterizer_Subpixel,  // half-space on 28.4 fixed point vertices
+  Rasterizer_Scanline,  // the original one, kept for comparison
+};
+
+// When the pixels are shaded
+enum ShadingMode {
+  Shading_Forward,     // whenever a triangle passes the depth test there
+  Shading_Visibility,  // once, see renderer_visibility.cpp
+  // Once, by the first triangle at the depth a depth-only pass of the
+  // whole tile left
+  Shading_DepthPrepass,
+};
+
+// Edges of the model drawn over the frame, see renderer_wireframe.cpp
+enum WireframeMode {
+  Wireframe_Off,
+  Wireframe_Overlay,  // over the shaded model
+  Wireframe_Only,     // instead of the faces
+};
+
+// How a frame sink writes the frames, see renderer_sink.cpp
+enum FrameSinkFormat {
+  FrameSink_RGB24,  // raw, 3 bytes a pixel, red first
+  FrameSink_BGRA,   // raw, the backbuffer as it is with alpha 255
+  FrameSink_PPM,    // one image file per frame
+  FrameSink_QOI,
+};
+
+struct RenderSettings {
+  RasterizerType rasterizer;
+  bool32 scalar_only;  // don't use the SIMD kernels of the half-space path
+
+  // Bin the half-space triangles into tiles and draw the tiles in parallel
+  bool32 binned;
+  int thread_count;
+
+  // Applied when the model is loaded
+  FaceOrder face_order;
+
+  // Sample the full size texture only, without mipmaps
+  bool32 base_level_only;
+
+  // Distance of the perspective camera on the z axis, 0 for an orthographic
+  // view. It has to be further out than the model, which isn't clipped
+  r32 camera_distance;
+  // Interpolate texture coordinates on the screen even in perspective
+  bool32 affine_texture;
+
+  // Half-space pipeline state of the model, the scanline path ignores it
+  bool32 gouraud;     // interpolate the lighting from the vertex normals
+  bool32 untextured;  // white instead of the diffuse texture
+  r32 transparency;   // above 0 blends the model over the background
+
+  // Not for the scanline path. The modes other than forward bin the faces
+  // even when binned is false
+  ShadingMode shading;
+
+  WireframeMode wireframe;
+
+  // Skip the frames the buffer already holds, see SceneState
+  bool32 incremental;
+};
+
+// Where the model is seen from. The camera circles the origin, the model
+// is turned by yaw degrees around y and then by pitch degrees around x,
+// and seen along -z. Faces that face away from the light aren't drawn
+struct RenderView {
+  r32 yaw;
+  r32 pitch;
+  r32 camera_distance;  // as in RenderSettings
+  v3 light_direction;   // in the view, {0, 0, -1} shines along it
+};
+
+// Everything a frame depends on. When nothing has changed since a buffer
+// was drawn into, it still holds the frame. Compared as a whole, so it
+// has no padding
+struct SceneState {
+  u32 model_version;  // 0 when nothing has been drawn
+  v3 light_direction;
+  RenderSettings settings;  // includes the camera
+  int width;
+  int height;
+};
+
+struct GameOffscreenBuffer {
+  void *memory;
+  int width;
+  int height;
+  int bytes_per_pixel;
+  int max_width;  // We'll only allocate this much
+  int max_height;
+  // Sized for width x height in depth_memory, see ResizeBuffer
+  int *z_buffer;
+  DepthBlock *depth_blocks;
+  DepthTile *depth_tiles;
+  u8 *depth_memory;  // for max_width x max_height
+  u64 depth_memory_size;
+
+  u32 generation;  // bumped by every clear
+  u32 clear_color;
+
+  SceneState scene;  // the buffer holds a frame of this scene
 };
@@ -0,0 +1,189 @@
+#ifndef RENDERER_BATCH_CPP
+#define RENDERER_BATCH_CPP
+
+// Batch rendering.
+// Offline jobs like turntables draw many views of the same model, and
+// drawing whole frames in parallel scales better than splitting every
+// frame into tiles. Each thread draws one frame at a time into its own
+// buffer, with its own scratch arena, and only reads the model and the
+// settings. A finished frame is handed to the caller on the thread that
+// drew it, so that it is written out in parallel as well.
+
+#define BATCH_FRAME(name) \
+  void name(GameOffscreenBuffer *buffer, int frame_index, void *data)
+typedef BATCH_FRAME(BatchFrameCallback);
+
+struct RenderBatch {
+  RenderView *views;
+  int view_count;
+  i32 volatile next_view;
+  i32 volatile failed_count;  // the scratch didn't fit
+
+  BatchFrameCallback *done;
+  void *done_data;
+};
+
+struct BatchWorker {
+  RenderBatch *batch;
+  GameOffscreenBuffer buffer;
+  MemoryArena arena;
+};
+
+internal PLATFORM_WORK_QUEUE_CALLBACK(RenderBatchWork) {
+  BatchWorker *worker = (BatchWorker *)data;
+  RenderBatch *batch = worker->batch;
+  for (;;) {
+    int index = AtomicAddI32(&batch->next_view, 1);
+    if (index >= batch->view_count) break;
+
+    if (DrawView(&worker->buffer, &worker->arena, &batch->views[index], 1)) {
+      batch->done(&worker->buffer, index, batch->done_data);
+    } else {
+      AtomicAddI32(&batch->failed_count, 1);
+    }
+  }
+}
+
+// Draws the views at width x height on thread_count threads, the calling
+// one included, and calls done for every frame that was drawn. The model
+// has to be loaded. The buffers are temporary memory on the arena, and
+// what is left of it is split evenly into the scratch of the threads.
+// Returns the number of frames drawn
+internal int RenderBatchViews(RenderView *views, int view_count, int width,
+                              int height, int thread_count,
+                              MemoryArena *arena, BatchFrameCallback *done,
+                              void *done_data) {
+  RenderBatch batch = {};
+  batch.views = views;
+  batch.view_count = view_count;
+  batch.done = done;
+  batch.done_data = done_data;
+
+  int worker_count = Min(Max(thread_count, 1), Max(view_count, 1));
+  if (!g_render_queue) worker_count = 1;
+
+  TemporaryMemory temp = BeginTemporaryMemory(arena);
+  BatchWorker *workers = PushArray(arena, worker_count, BatchWorker);
+  bool32 result = workers != 0;
+  for (int i = 0; result && i < worker_count; ++i) {
+    workers[i] = {};
+    workers[i].batch = &batch;
+    result = AllocateBuffer(&workers[i].buffer, arena, width, height);
+    if (result) ResizeBuffer(&workers[i].buffer, width, height);
+  }
+
+  if (result) {
+    // Leaves room for aligning the first one
+    u64 free_size = arena->size - arena->used;
+    if (free_size < kArenaAlignment) free_size = kArenaAlignment;
+    free_size -= kArenaAlignment;
+    u64 scratch_size = (free_size / worker_count) & ~(kArenaAlignment - 1);
+    for (int i = 0; result && i < worker_count; ++i) {
+      result = SubArena(&workers[i].arena, arena, scratch_size);
+    }
+  }
+
+  int drawn_count = 0;
+  if (result) {
+    if (worker_count == 1) {
+      RenderBatchWork(0, &workers[0]);
+    } else {
+      for (int i = 0; i < worker_count; ++i) {
+        PlatformAddWorkEntry(g_render_queue, RenderBatchWork, &workers[i]);
+      }
+      PlatformCompleteAllWork(g_render_queue);
+    }
+    drawn_count = view_count - batch.failed_count;
+  }
+
+  EndTemporaryMemory(temp);
+  return drawn_count;
+}
+
+// Views all the way around the model in count equal steps of the yaw,
+// starting from base, which gives everything else
+internal RenderView *MakeOrbitViews(MemoryArena *arena, int count,
+                                    RenderView base) {
+  RenderView *views = PushArray(arena, count, RenderView);
+  if (!views) return 0;
+
+  for (int i = 0; i < count; ++i) {
+    views[i] = base;
+    views[i].yaw = base.yaw + 360.0f * i / count;
+  }
+  return views;
+}
+
+// Parses the view on the line, values that aren't there come from
+// defaults. Returns false if the line doesn't parse
+internal bool32 ParseRenderView(char *at, char *end, RenderView defaults,
+                                RenderView *view) {
+  const int kMaxValues = 6;
+  r32 values[kMaxValues];
+  int value_count = 0;
+  for (;;) {
+    at = SkipModelSpaces(at, end);
+    if (at == end) break;
+    if (value_count == kMaxValues) return false;
+
+    char *start = at;
+    at = ParseModelReal32(at, end, &values[value_count++]);
+    if (at == start || (at < end && !IsModelSpace(*at))) return false;
+  }
+  // The light needs all of x, y and z
+  if (value_count == 0 || value_count == 4 || value_count == 5) return false;
+
+  *view = defaults;
+  view->yaw = values[0];
+  if (value_count > 1) view->pitch = values[1];
+  if (value_count > 2) view->camera_distance = values[2];
+  if (value_count > 5) {
+    view->light_direction = {values[3], values[4], values[5]};
+    if (V3Length(view->light_direction) == 0) return false;
+  }
+  return true;
+}
+
+inline bool32 IsViewLineEmpty(char *at, char *end) {
+  at = SkipModelSpaces(at, end);
+  bool32 result = at == end || *at == '#';
+  return result;
+}
+
+// One view per line, "yaw [pitch [camera_distance [light_x light_y
+// light_z]]]", angles in degrees. Blank lines and lines starting with #
+// are skipped. The views are pushed onto the arena. Returns 0 if a line
+// doesn't parse, with its number in error_line
+internal RenderView *ParseRenderViews(char *text, u64 size,
+                                      MemoryArena *arena,
+                                      RenderView defaults, int *count,
+                                      int *error_line) {
+  char *end = text + size;
+  *count = 0;
+  *error_line = 0;
+  for (char *at = text; at < end;) {
+    char *line_end = (char *)memchr(at, '\n', end - at);
+    if (!line_end) line_end = end;
+    if (!IsViewLineEmpty(at, line_end)) (*count)++;
+    at = line_end + 1;
+  }
+
+  RenderView *views = PushArray(arena, *count, RenderView);
+  if (!views) return 0;
+
+  int index = 0;
+  int line = 1;
+  for (char *at = text; at < end; ++line) {
+    char *line_end = (char *)memchr(at, '\n', end - at);
+    if (!line_end) line_end = end;
+    if (!IsViewLineEmpty(at, line_end) &&
+        !ParseRenderView(at, line_end, defaults, &views[index++])) {
+      *error_line = line;
+      return 0;
+    }
+    at = line_end + 1;
+  }
+  return views;
+}
+
+#endif  // RENDERER_BATCH_CPP
@@ -0,0 +1,351 @@
+#ifndef RENDERER_DEBUG_CPP
+#define RENDERER_DEBUG_CPP
+
+// Instrumentation, only in BUILD_INTERNAL builds.
+//
+// TIMED_BLOCK(name) counts the hits and the cycles of the enclosing scope
+// under DebugCycle_name, and DEBUG_COUNT(name, n) adds to the pipeline
+// counter DebugCounter_name. Both compile to nothing otherwise.
+//
+// Every thread records into its own DebugThreadRecord, so the workers
+// drawing tiles never share a cache line or need atomics. The records are
+// summed when the report is printed, which has to happen while no frame
+// is being drawn. Cycles are summed over the threads too, so the blocks
+// that run in parallel can add up to more than the frame.
+//
+// With a trace started, every timed block also leaves an event, and the
+// events can be written out as Chrome trace JSON (chrome://tracing or
+// ui.perfetto.dev).
+
+#if BUILD_INTERNAL
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define DEBUG_HAS_RDTSC 1
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define DEBUG_HAS_RDTSC 1
+#endif
+
+enum DebugCycleCounterType {
+  DebugCycle_Render,
+  DebugCycle_LoadModel,
+  DebugCycle_TransformVertices,
+  DebugCycle_SetupTriangles,
+  DebugCycle_BinTriangles,
+  DebugCycle_DrawTiles,
+  DebugCycle_DrawTile,
+  DebugCycle_RasterizeTriangle,
+  DebugCycle_ScanlineTriangle,
+  DebugCycle_ResolveVisibility,
+  DebugCycle_ResolveBuffer,
+  DebugCycle_DrawWireframe,
+  DebugCycle_RenderShadowMap,
+  DebugCycle_Present,
+  DebugCycle_SubmitFrame,
+  DebugCycle_WriteSinkFrame,
+
+  DebugCycle_Count,
+};
+
+global const char *g_debug_cycle_names[] = {
+    "Render",            "LoadModel",         "TransformVertices",
+    "SetupTriangles",    "BinTriangles",      "DrawTiles",
+    "DrawTile",          "RasterizeTriangle", "ScanlineTriangle",
+    "ResolveVisibility", "ResolveBuffer",     "DrawWireframe",
+    "RenderShadowMap",   "Present",           "SubmitFrame",
+    "WriteSinkFrame",
+};
+
+enum DebugCounterType {
+  DebugCounter_FramesDrawn,
+  DebugCounter_FacesSubmitted,   // every face of the model, every frame
+  DebugCounter_FacesRasterized,  // set up and handed to a rasterizer
+  DebugCounter_PixelsTested,     // inside a triangle, at the depth test
+  DebugCounter_PixelsPassed,     // passed the depth test
+  DebugCounter_PixelsShaded,     // had their color written
+  DebugCounter_PixelsCovered,    // distinct pixels drawn, see DebugEndFrame
+
+  DebugCounter_Count,
+};
+
+struct DebugCycleCounter {
+  u64 cycles;
+  u64 hits;
+};
+
+// A timed block, start and cycles in cycle counter ticks
+struct DebugTraceEvent {
+  u64 start;
+  u32 cycles;
+  u16 counter;  // DebugCycleCounterType
+  u16 thread;
+};
+
+// Padded so no two threads write to the same cache line
+struct DebugThreadRecord {
+  DebugCycleCounter cycle_counters[DebugCycle_Count];
+  u64 counters[DebugCounter_Count];
+  u8 padding[64];
+};
+
+// Every render thread, and the presenter and the frame sink writer
+const int kDebugMaxThreads = kMaxThreadCount + 2;
+
+struct DebugState {
+  DebugThreadRecord threads[kDebugMaxThreads];
+  i32 volatile thread_count;
+
+  // Covered pixels take a pass over the z-buffer, so they're only counted
+  // when the report asks for the overdraw
+  bool32 count_coverage;
+
+  // Shared by all threads, taken with an atomic add. Events past the end
+  // are dropped
+  DebugTraceEvent *events;
+  i32 volatile event_count;
+  i32 max_event_count;
+  u64 trace_start_ticks;
+  u64 trace_start_ns;
+};
+
+global DebugState g_debug_state;
+thread_local int t_debug_thread_index = -1;
+
+// Ticks of the time stamp counter, or nanoseconds where there is none
+inline u64 GetCycleCount() {
+#if DEBUG_HAS_RDTSC
+  u64 result = __rdtsc();
+#else
+  u64 result = PlatformGetWallClock();
+#endif
+  return result;
+}
+
+inline int GetDebugThreadIndex() {
+  if (t_debug_thread_index < 0) {
+    t_debug_thread_index = AtomicAddI32(&g_debug_state.thread_count, 1);
+  }
+  return t_debug_thread_index;
+}
+
+// Returns 0 for threads past the records, which aren't recorded at all
+// rather than racing on a shared record
+inline DebugThreadRecord *GetDebugThreadRecord() {
+  int index = GetDebugThreadIndex();
+  DebugThreadRecord *result =
+      index < kDebugMaxThreads ? &g_debug_state.threads[index] : 0;
+  return result;
+}
+
+struct TimedBlock {
+  DebugCycleCounterType counter;
+  u64 start;
+
+  TimedBlock(DebugCycleCounterType counter_init) {
+    counter = counter_init;
+    start = GetCycleCount();
+  }
+
+  ~TimedBlock() {
+    u64 cycles = GetCycleCount() - start;
+    DebugThreadRecord *record = GetDebugThreadRecord();
+    if (!record) return;
+    int thread = GetDebugThreadIndex();
+    DebugCycleCounter *cycle_counter = &record->cycle_counters[counter];
+    cycle_counter->cycles += cycles;
+    cycle_counter->hits++;
+
+    if (g_debug_state.events) {
+      int index = AtomicAddI32(&g_debug_state.event_count, 1);
+      if (index < g_debug_state.max_event_count) {
+        DebugTraceEvent *event = &g_debug_state.events[index];
+        event->start = start;
+        event->cycles = cycles < UINT_MAX ? (u32)cycles : UINT_MAX;
+        event->counter = (u16)counter;
+        event->thread = (u16)thread;
+      }
+    }
+  }
+};
+
+#define TIMED_BLOCK__(name, line) \
+  TimedBlock timed_block_##line(DebugCycle_##name)
+#define TIMED_BLOCK_(name, line) TIMED_BLOCK__(name, line)
+#define TIMED_BLOCK(name) TIMED_BLOCK_(name, __LINE__)
+
+inline void DebugCount(DebugCounterType counter, u64 value) {
+  DebugThreadRecord *record = GetDebugThreadRecord();
+  if (record) record->counters[counter] += value;
+}
+
+#define DEBUG_COUNT(name, value) DebugCount(DebugCounter_##name, (value))
+
+// For counts that are kept in a local first, see RasterCounts
+#define DEBUG_ADD(variable, value) ((variable) += (value))
+
+inline u64 SumCounter(DebugCounterType counter) {
+  u64 result = 0;
+  for (int i = 0; i < kDebugMaxThreads; ++i) {
+    result += g_debug_state.threads[i].counters[counter];
+  }
+  return result;
+}
+
+inline DebugCycleCounter SumCycleCounter(DebugCycleCounterType counter) {
+  DebugCycleCounter result = {};
+  for (int i = 0; i < kDebugMaxThreads; ++i) {
+    result.cycles += g_debug_state.threads[i].cycle_counters[counter].cycles;
+    result.hits += g_debug_state.threads[i].cycle_counters[counter].hits;
+  }
+  return result;
+}
+
+// Counts the frame, and the pixels something was drawn into when the
+// overdraw is wanted. Only the tiles cleared this frame can have any
+internal void DebugEndFrame(GameOffscreenBuffer *buffer) {
+  DEBUG_COUNT(FramesDrawn, 1);
+  if (!g_debug_state.count_coverage) return;
+
+  u64 covered = 0;
+  int tiles_x = GetDepthTilesX(buffer);
+  int tiles_y = GetDepthTilesY(buffer);
+  for (int tile_y = 0; tile_y < tiles_y; ++tile_y) {
+    for (int tile_x = 0; tile_x < tiles_x; ++tile_x) {
+      DepthTile *tile = &buffer->depth_tiles[tile_y * tiles_x + tile_x];
+      if (tile->generation != buffer->generation) continue;
+
+      Rect2i rect = GetDepthTileRect(buffer, tile_x, tile_y);
+      for (int y = rect.min_y; y <= rect.max_y; ++y) {
+        int *depth = buffer->z_buffer + y * buffer->width;
+        for (int x = rect.min_x; x <= rect.max_x; ++x) {
+          covered += depth[x] != INT_MIN;
+        }
+      }
+    }
+  }
+  DEBUG_COUNT(PixelsCovered, covered);
+}
+
+// Counting the covered pixels takes a pass over the z-buffer per frame
+inline void DebugCountOverdraw(bool32 enabled) {
+  g_debug_state.count_coverage = enabled;
+}
+
+internal void DebugResetCounters() {
+  for (int i = 0; i < kDebugMaxThreads; ++i) {
+    DebugThreadRecord *record = &g_debug_state.threads[i];
+    memset(record->cycle_counters, 0, sizeof(record->cycle_counters));
+    memset(record->counters, 0, sizeof(record->counters));
+  }
+}
+
+// Per drawn frame averages of everything recorded so far
+internal void DebugPrintReport() {
+  u64 frames = SumCounter(DebugCounter_FramesDrawn);
+  r64 per_frame = frames ? 1.0 / frames : 0.0;
+  printf("timed blocks over %llu drawn frames, summed over the threads\n",
+         (unsigned long long)frames);
+  printf("block              hits/frame  kcycles/frame  cycles/hit\n");
+  for (int i = 0; i < DebugCycle_Count; ++i) {
+    DebugCycleCounter counter = SumCycleCounter((DebugCycleCounterType)i);
+    if (!counter.hits) continue;
+    printf("%-17s  %10.1f  %13.1f  %10.0f\n", g_debug_cycle_names[i],
+           counter.hits * per_frame, counter.cycles * per_frame / 1000.0,
+           (r64)counter.cycles / counter.hits);
+  }
+
+  r64 submitted = SumCounter(DebugCounter_FacesSubmitted) * per_frame;
+  r64 rasterized = SumCounter(DebugCounter_FacesRasterized) * per_frame;
+  r64 tested = SumCounter(DebugCounter_PixelsTested) * per_frame;
+  r64 passed = SumCounter(DebugCounter_PixelsPassed) * per_frame;
+  r64 shaded = SumCounter(DebugCounter_PixelsShaded) * per_frame;
+  printf("faces per frame: %.0f submitted, %.0f culled, %.0f rasterized\n",
+         submitted, submitted - rasterized, rasterized);
+  printf("pixels per frame: %.0f tested, %.0f passed (%.1f%%), %.0f shaded",
+         tested, passed, tested > 0 ? 100.0 * passed / tested : 0.0,
+         shaded);
+  if (g_debug_state.count_coverage) {
+    r64 covered = SumCounter(DebugCounter_PixelsCovered) * per_frame;
+    printf(", overdraw %.3f", covered > 0 ? shaded / covered : 0.0);
+  }
+  printf("\n");
+}
+
+// Records the timed blocks as events from here on, up to max_event_count
+// of them. Returns false if they don't fit in the arena
+internal bool32 DebugStartTrace(MemoryArena *arena, int max_event_count) {
+  g_debug_state.events = PushArray(arena, max_event_count, DebugTraceEvent);
+  if (!g_debug_state.events) return false;
+
+  g_debug_state.max_event_count = max_event_count;
+  g_debug_state.event_count = 0;
+  g_debug_state.trace_start_ns = PlatformGetWallClock();
+  g_debug_state.trace_start_ticks = GetCycleCount();
+  return true;
+}
+
+// Writes the events as Chrome trace JSON, with the ticks converted to
+// microseconds against the wall clock. The text is frame scratch on the
+// arena. No blocks may be running
+internal bool32 DebugWriteTrace(MemoryArena *arena, const char *filename) {
+  if (!g_debug_state.events) return false;
+
+  r64 elapsed_ns =
+      (r64)(PlatformGetWallClock() - g_debug_state.trace_start_ns);
+  r64 elapsed_ticks =
+      (r64)(GetCycleCount() - g_debug_state.trace_start_ticks);
+  r64 us_per_tick = elapsed_ticks > 0 ? elapsed_ns / elapsed_ticks / 1000.0
+                                      : 0.0;
+
+  int event_count =
+      Min((int)g_debug_state.event_count, g_debug_state.max_event_count);
+  const u64 kMaxEventText = 128;
+  TemporaryMemory temp = BeginTemporaryMemory(arena);
+  u64 capacity = (u64)(event_count + 1) * kMaxEventText;
+  char *text = PushArray(arena, capacity, char);
+  bool32 result = false;
+  if (text) {
+    u64 used = snprintf(text, capacity, "{\"traceEvents\":[");
+    for (int i = 0; i < event_count; ++i) {
+      DebugTraceEvent *event = &g_debug_state.events[i];
+      r64 start_us =
+          (r64)(event->start - g_debug_state.trace_start_ticks) * us_per_tick;
+      used += snprintf(text + used, capacity - used,
+                       "%s\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,"
+                       "\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+                       i ? "," : "", g_debug_cycle_names[event->counter],
+                       event->thread, start_us, event->cycles * us_per_tick);
+    }
+    used += snprintf(text + used, capacity - used, "\n]}\n");
+    result = PlatformWriteEntireFile(filename, text, used);
+  }
+  EndTemporaryMemory(temp);
+  return result;
+}
+
+#else
+
+#define TIMED_BLOCK(name)
+#define DEBUG_COUNT(name, value)
+#define DEBUG_ADD(variable, value)
+
+inline void DebugEndFrame(GameOffscreenBuffer *buffer) {}
+inline void DebugCountOverdraw(bool32 enabled) {}
+inline void DebugResetCounters() {}
+
+inline void DebugPrintReport() {
+  printf("no timed blocks or counters, this build isn't BUILD_INTERNAL\n");
+}
+
+inline bool32 DebugStartTrace(MemoryArena *arena, int max_event_count) {
+  return false;
+}
+
+inline bool32 DebugWriteTrace(MemoryArena *arena, const char *filename) {
+  return false;
+}
+
+#endif  // BUILD_INTERNAL
+
+#endif  // RENDERER_DEBUG_CPP
@@ -0,0 +1,335 @@
+#ifndef RENDERER_DEPTH_CPP
+#define RENDERER_DEPTH_CPP
+
+// Depth buffer, hierarchical depth and clears.
+//
+// Next to the z-buffer we keep the depth range of every 8x8 block, and the
+// farthest depth of every 64x64 tile. Larger z is closer, so a triangle
+// that is not closer than z_min of a block can't pass the depth test
+// anywhere in it, and a triangle that is closer than z_max passes it
+// everywhere. The bounds are conservative: z_min may be lower and z_max
+// may be higher than the real values.
+//
+// Clearing is lazy. ClearBuffer only bumps the buffer generation, and a
+// tile is cleared when something is first drawn into it in the new
+// generation (PrepareDepthTiles). Tiles that are not drawn into keep
+// their old contents until ResolveBuffer, which clears the color of those
+// that had something drawn into them before. Tiles that stay empty are
+// never written.
+
+const int kDepthBlockSize = 8;  // same as the rasterizer blocks
+const int kDepthTileSize = 64;
+const int kDepthTileBlocks = kDepthTileSize / kDepthBlockSize;
+
+inline int GetDepthBlocksX(GameOffscreenBuffer *buffer) {
+  int result = (buffer->width + kDepthBlockSize - 1) / kDepthBlockSize;
+  return result;
+}
+
+inline int GetDepthBlocksY(GameOffscreenBuffer *buffer) {
+  int result = (buffer->height + kDepthBlockSize - 1) / kDepthBlockSize;
+  return result;
+}
+
+inline int GetDepthTilesX(GameOffscreenBuffer *buffer) {
+  int result = (buffer->width + kDepthTileSize - 1) / kDepthTileSize;
+  return result;
+}
+
+inline int GetDepthTilesY(GameOffscreenBuffer *buffer) {
+  int result = (buffer->height + kDepthTileSize - 1) / kDepthTileSize;
+  return result;
+}
+
+inline DepthBlock *GetDepthBlock(GameOffscreenBuffer *buffer, int block_x,
+                                 int block_y) {
+  DepthBlock *result =
+      buffer->depth_blocks + (block_y / kDepthBlockSize) *
+                                 GetDepthBlocksX(buffer) +
+      block_x / kDepthBlockSize;
+  return result;
+}
+
+inline u32 *GetPixel(GameOffscreenBuffer *buffer, int x, int y) {
+  // Point 0, 0 is in the left bottom corner
+  int pitch = buffer->width * buffer->bytes_per_pixel;
+  u8 *row = (u8 *)buffer->memory + (buffer->height - 1 - y) * pitch +
+            x * buffer->bytes_per_pixel;
+  return (u32 *)row;
+}
+
+internal void FillColor(GameOffscreenBuffer *buffer, Rect2i rect, u32 color) {
+  for (int y = rect.min_y; y <= rect.max_y; ++y) {
+    u32 *pixel = GetPixel(buffer, rect.min_x, y);
+    for (int x = rect.min_x; x <= rect.max_x; ++x) {
+      *pixel++ = color;
+    }
+  }
+}
+
+inline Rect2i GetDepthTileRect(GameOffscreenBuffer *buffer, int tile_x,
+                               int tile_y) {
+  Rect2i result;
+  result.min_x = tile_x * kDepthTileSize;
+  result.min_y = tile_y * kDepthTileSize;
+  result.max_x = Min(result.min_x + kDepthTileSize, buffer->width) - 1;
+  result.max_y = Min(result.min_y + kDepthTileSize, buffer->height) - 1;
+  return result;
+}
+
+// Depth memory of a width x height buffer
+inline u64 GetDepthMemorySize(int width, int height) {
+  u64 blocks_x = (width + kDepthBlockSize - 1) / kDepthBlockSize;
+  u64 blocks_y = (height + kDepthBlockSize - 1) / kDepthBlockSize;
+  u64 tiles_x = (width + kDepthTileSize - 1) / kDepthTileSize;
+  u64 tiles_y = (height + kDepthTileSize - 1) / kDepthTileSize;
+  u64 result = (u64)width * height * sizeof(int) +
+               blocks_x * blocks_y * sizeof(DepthBlock) +
+               tiles_x * tiles_y * sizeof(DepthTile);
+  return result;
+}
+
+// Pushes the color and depth memory for the largest size the buffer can
+// have, resizing only lays them out again. Returns false if they don't fit
+internal bool32 AllocateBuffer(GameOffscreenBuffer *buffer,
+                               MemoryArena *arena, int max_width,
+                               int max_height) {
+  buffer->max_width = max_width;
+  buffer->max_height = max_height;
+  buffer->bytes_per_pixel = 4;
+  buffer->memory = PushSize(
+      arena, (u64)max_width * max_height * buffer->bytes_per_pixel);
+  buffer->depth_memory_size = GetDepthMemorySize(max_width, max_height);
+  buffer->depth_memory = (u8 *)PushSize(arena, buffer->depth_memory_size);
+
+  bool32 result = buffer->memory && buffer->depth_memory;
+  if (!result) *buffer = {};
+  return result;
+}
+
+// Same without the color memory, for buffers that are only drawn into with
+// RasterPass_DepthOnly, like shadow maps
+internal bool32 AllocateDepthBuffer(GameOffscreenBuffer *buffer,
+                                    MemoryArena *arena, int max_width,
+                                    int max_height) {
+  buffer->max_width = max_width;
+  buffer->max_height = max_height;
+  buffer->bytes_per_pixel = 4;
+  buffer->memory = 0;
+  buffer->depth_memory_size = GetDepthMemorySize(max_width, max_height);
+  buffer->depth_memory = (u8 *)PushSize(arena, buffer->depth_memory_size);
+
+  bool32 result = buffer->depth_memory != 0;
+  if (!result) *buffer = {};
+  return result;
+}
+
+// Sets the size of the buffer and lays the depth buffers out to fit.
+// Everything is cleared
+internal void ResizeBuffer(GameOffscreenBuffer *buffer, int width,
+                           int height) {
+  if (width > buffer->max_width) width = buffer->max_width;
+  if (height > buffer->max_height) height = buffer->max_height;
+  if (width < 0) width = 0;
+  if (height < 0) height = 0;
+
+  buffer->width = width;
+  buffer->height = height;
+
+  int pixel_count = width * height;
+  int block_count = GetDepthBlocksX(buffer) * GetDepthBlocksY(buffer);
+  int tile_count = GetDepthTilesX(buffer) * GetDepthTilesY(buffer);
+
+  buffer->z_buffer = 0;
+  buffer->depth_blocks = 0;
+  buffer->depth_tiles = 0;
+  if (pixel_count > 0) {
+    u8 *memory = buffer->depth_memory;
+    buffer->z_buffer = (int *)memory;
+    memory += pixel_count * sizeof(int);
+    buffer->depth_blocks = (DepthBlock *)memory;
+    memory += block_count * sizeof(DepthBlock);
+    buffer->depth_tiles = (DepthTile *)memory;
+  }
+
+  // The layout of the color buffer has changed, so it is cleared right
+  // away, and the depth tiles are left for the next frame to clear.
+  // Whatever frame the buffer held is gone
+  buffer->scene.model_version = 0;
+  for (int i = 0; i < tile_count; ++i) {
+    buffer->depth_tiles[i].generation = 0;
+    buffer->depth_tiles[i].has_color = false;
+  }
+  if (pixel_count > 0 && buffer->memory) {
+    Rect2i screen = {0, 0, width - 1, height - 1};
+    FillColor(buffer, screen, buffer->clear_color);
+  }
+  if (buffer->generation == 0) buffer->generation = 1;
+}
+
+// Starts a new frame, nothing is written until the tiles are drawn into
+inline void ClearBuffer(GameOffscreenBuffer *buffer, u32 clear_color) {
+  buffer->generation++;
+  if (buffer->generation == 0) {
+    // Wrapped around, make sure no tile looks up to date
+    for (int i = 0; i < GetDepthTilesX(buffer) * GetDepthTilesY(buffer);
+         ++i) {
+      buffer->depth_tiles[i].generation = 0;
+    }
+    buffer->generation = 1;
+  }
+  buffer->clear_color = clear_color;
+}
+
+internal void ClearDepthTile(GameOffscreenBuffer *buffer, DepthTile *tile,
+                             int tile_x, int tile_y) {
+  tile->generation = buffer->generation;
+  tile->z_min = INT_MIN;
+  tile->has_color = buffer->memory != 0;
+
+  Rect2i rect = GetDepthTileRect(buffer, tile_x, tile_y);
+  if (buffer->memory) FillColor(buffer, rect, buffer->clear_color);
+
+  for (int y = rect.min_y; y <= rect.max_y; ++y) {
+    int *depth = buffer->z_buffer + y * buffer->width;
+    for (int x = rect.min_x; x <= rect.max_x; ++x) {
+      depth[x] = INT_MIN;
+    }
+  }
+
+  for (int block_y = rect.min_y; block_y <= rect.max_y;
+       block_y += kDepthBlockSize) {
+    for (int block_x = rect.min_x; block_x <= rect.max_x;
+         block_x += kDepthBlockSize) {
+      DepthBlock *block = GetDepthBlock(buffer, block_x, block_y);
+      block->z_min = INT_MIN;
+      block->z_max = INT_MIN;
+    }
+  }
+}
+
+// Clears the tiles inside rect that haven't been cleared this frame.
+// Has to be called before anything is drawn there
+inline void PrepareDepthTiles(GameOffscreenBuffer *buffer, Rect2i rect) {
+  int tiles_x = GetDepthTilesX(buffer);
+  for (int y = rect.min_y / kDepthTileSize; y <= rect.max_y / kDepthTileSize;
+       ++y) {
+    for (int x = rect.min_x / kDepthTileSize;
+         x <= rect.max_x / kDepthTileSize; ++x) {
+      DepthTile *tile = &buffer->depth_tiles[y * tiles_x + x];
+      if (tile->generation != buffer->generation) {
+        ClearDepthTile(buffer, tile, x, y);
+      }
+    }
+  }
+}
+
+// Clears the color of the tiles that were drawn before, but not this frame
+internal void ResolveBuffer(GameOffscreenBuffer *buffer) {
+  int tiles_x = GetDepthTilesX(buffer);
+  int tiles_y = GetDepthTilesY(buffer);
+  for (int y = 0; y < tiles_y; ++y) {
+    for (int x = 0; x < tiles_x; ++x) {
+      DepthTile *tile = &buffer->depth_tiles[y * tiles_x + x];
+      if (tile->generation != buffer->generation && tile->has_color) {
+        FillColor(buffer, GetDepthTileRect(buffer, x, y),
+                  buffer->clear_color);
+        tile->has_color = false;
+      }
+    }
+  }
+}
+
+// Moves everything drawn into the tile one step further away, the bounds
+// included. After a depth-only prepass the strict depth test then passes
+// exactly at the depth the prepass left, see Shading_DepthPrepass
+internal void LowerTileDepth(GameOffscreenBuffer *buffer, Rect2i tile_rect) {
+  int tiles_x = GetDepthTilesX(buffer);
+  DepthTile *tile =
+      &buffer->depth_tiles[(tile_rect.min_y / kDepthTileSize) * tiles_x +
+                           tile_rect.min_x / kDepthTileSize];
+  if (tile->generation != buffer->generation) return;  // nothing drawn
+  if (tile->z_min != INT_MIN) tile->z_min--;
+
+  for (int y = tile_rect.min_y; y <= tile_rect.max_y; ++y) {
+    int *depth = buffer->z_buffer + y * buffer->width;
+    for (int x = tile_rect.min_x; x <= tile_rect.max_x; ++x) {
+      if (depth[x] != INT_MIN) depth[x]--;
+    }
+  }
+
+  for (int block_y = tile_rect.min_y; block_y <= tile_rect.max_y;
+       block_y += kDepthBlockSize) {
+    for (int block_x = tile_rect.min_x; block_x <= tile_rect.max_x;
+         block_x += kDepthBlockSize) {
+      DepthBlock *block = GetDepthBlock(buffer, block_x, block_y);
+      if (block->z_min != INT_MIN) block->z_min--;
+      if (block->z_max != INT_MIN) block->z_max--;
+    }
+  }
+}
+
+// True if a triangle no closer than z_max is hidden everywhere in rect.
+// The tiles must be prepared
+internal bool32 IsRectOccluded(GameOffscreenBuffer *buffer, Rect2i rect,
+                               int z_max) {
+  int tiles_x = GetDepthTilesX(buffer);
+  for (int y = rect.min_y / kDepthTileSize; y <= rect.max_y / kDepthTileSize;
+       ++y) {
+    for (int x = rect.min_x / kDepthTileSize;
+         x <= rect.max_x / kDepthTileSize; ++x) {
+      if (z_max > buffer->depth_tiles[y * tiles_x + x].z_min) return false;
+    }
+  }
+  return true;
+}
+
+// Recomputes z_min of a block from the z-buffer, and returns whether it
+// went up
+internal bool32 RefreshDepthBlockMin(GameOffscreenBuffer *buffer,
+                                     DepthBlock *block, int block_x,
+                                     int block_y) {
+  int x1 = Min(block_x + kDepthBlockSize, buffer->width);
+  int y1 = Min(block_y + kDepthBlockSize, buffer->height);
+
+  int z_min = INT_MAX;
+  for (int y = block_y; y < y1; ++y) {
+    int *depth = buffer->z_buffer + y * buffer->width;
+    for (int x = block_x; x < x1; ++x) {
+      z_min = Min(z_min, depth[x]);
+    }
+  }
+
+  bool32 result = z_min > block->z_min;
+  block->z_min = z_min;
+  return result;
+}
+
+// Updates the tile minimums from the blocks inside rect
+internal void RefreshDepthTiles(GameOffscreenBuffer *buffer, Rect2i rect) {
+  int tiles_x = GetDepthTilesX(buffer);
+  int blocks_x = GetDepthBlocksX(buffer);
+  int blocks_y = GetDepthBlocksY(buffer);
+
+  for (int tile_y = rect.min_y / kDepthTileSize;
+       tile_y <= rect.max_y / kDepthTileSize; ++tile_y) {
+    for (int tile_x = rect.min_x / kDepthTileSize;
+         tile_x <= rect.max_x / kDepthTileSize; ++tile_x) {
+      int first_x = tile_x * kDepthTileBlocks;
+      int first_y = tile_y * kDepthTileBlocks;
+      int last_x = Min(first_x + kDepthTileBlocks, blocks_x);
+      int last_y = Min(first_y + kDepthTileBlocks, blocks_y);
+
+      int z_min = INT_MAX;
+      for (int y = first_y; y < last_y; ++y) {
+        DepthBlock *block = buffer->depth_blocks + y * blocks_x;
+        for (int x = first_x; x < last_x; ++x) {
+          z_min = Min(z_min, block[x].z_min);
+        }
+      }
+      buffer->depth_tiles[tile_y * tiles_x + tile_x].z_min = z_min;
+    }
+  }
+}
+
+#endif  // RENDERER_DEPTH_CPP
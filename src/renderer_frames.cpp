@@ -0,0 +1,128 @@
+#ifndef RENDERER_FRAMES_CPP
+#define RENDERER_FRAMES_CPP
+
+// Frame loop.
+// Frames are drawn into kFrameBufferCount buffers in turn. When a frame is
+// done it goes to the presenter thread, which hands it to the platform
+// while the next frame is drawn into another buffer, so the present takes
+// no time from drawing. The platform layer draws a frame with
+//
+//   GameOffscreenBuffer *buffer = BeginFrame(&loop);
+//   Render(buffer);
+//   EndFrame(&loop);
+//
+// BeginFrame waits for a buffer the presenter is done with, and sleeps
+// until the frame is due when the loop is paced. Frames are presented in
+// the order they were drawn.
+
+const int kFrameBufferCount = 2;
+
+#define PRESENT_FRAME(name) void name(GameOffscreenBuffer *buffer, void *data)
+typedef PRESENT_FRAME(PresentFrameCallback);
+
+struct FrameLoop {
+  GameOffscreenBuffer buffers[kFrameBufferCount];
+  u32 frames_drawn;      // by the drawing thread
+  u32 frames_presented;  // by the presenter thread
+
+  // Applied to each buffer before it's drawn into, so a resize never
+  // touches a buffer that is being presented
+  int volatile width;
+  int volatile height;
+
+  PresentFrameCallback *present;  // may be 0
+  void *present_data;
+
+  PlatformSemaphore free_buffers;  // neither drawn into nor presented
+  PlatformSemaphore drawn_frames;  // waiting for the presenter
+
+  u64 frame_ns;  // 0 draws as fast as possible
+  u64 next_frame_start;
+};
+
+internal PLATFORM_THREAD_PROC(PresentFrames) {
+  FrameLoop *loop = (FrameLoop *)data;
+  for (;;) {
+    PlatformWaitForSemaphore(&loop->drawn_frames);
+
+    int index = loop->frames_presented % kFrameBufferCount;
+    GameOffscreenBuffer *buffer = &loop->buffers[index];
+    if (loop->present) loop->present(buffer, loop->present_data);
+    loop->frames_presented++;
+
+    PlatformSignalSemaphore(&loop->free_buffers);
+  }
+}
+
+// Every buffer is max_width x max_height at most, and is pushed onto the
+// arena. A target_fps of 0 doesn't pace the frames
+internal void StartFrameLoop(FrameLoop *loop, MemoryArena *arena,
+                             int max_width, int max_height, int target_fps,
+                             PresentFrameCallback *present,
+                             void *present_data) {
+  for (int i = 0; i < kFrameBufferCount; ++i) {
+    // Too large for the arena, nothing gets drawn
+    AllocateBuffer(&loop->buffers[i], arena, max_width, max_height);
+  }
+  loop->frames_drawn = 0;
+  loop->frames_presented = 0;
+  loop->present = present;
+  loop->present_data = present_data;
+  loop->frame_ns = target_fps > 0 ? 1000000000ull / target_fps : 0;
+  loop->next_frame_start = PlatformGetWallClock();
+
+  PlatformInitSemaphore(&loop->free_buffers, kFrameBufferCount);
+  PlatformInitSemaphore(&loop->drawn_frames, 0);
+  PlatformStartThread(PresentFrames, loop);
+}
+
+// Takes effect from the next frame on
+inline void SetFrameSize(FrameLoop *loop, int width, int height) {
+  GameOffscreenBuffer *buffer = &loop->buffers[0];
+  loop->width = Max(Min(width, buffer->max_width), 0);
+  loop->height = Max(Min(height, buffer->max_height), 0);
+}
+
+internal GameOffscreenBuffer *BeginFrame(FrameLoop *loop) {
+  PlatformWaitForSemaphore(&loop->free_buffers);
+
+  int index = loop->frames_drawn % kFrameBufferCount;
+  GameOffscreenBuffer *buffer = &loop->buffers[index];
+  int width = loop->width;
+  int height = loop->height;
+  if (buffer->width != width || buffer->height != height ||
+      !buffer->z_buffer) {
+    ResizeBuffer(buffer, width, height);
+  }
+
+  if (loop->frame_ns) {
+    u64 now = PlatformGetWallClock();
+    if (now < loop->next_frame_start) {
+      PlatformSleep(loop->next_frame_start - now);
+      loop->next_frame_start += loop->frame_ns;
+    } else {
+      // Late, count the next frames from here instead of catching up
+      loop->next_frame_start = now + loop->frame_ns;
+    }
+  }
+
+  return buffer;
+}
+
+// Hands the buffer from the last BeginFrame to the presenter
+inline void EndFrame(FrameLoop *loop) {
+  loop->frames_drawn++;
+  PlatformSignalSemaphore(&loop->drawn_frames);
+}
+
+// Waits until every frame drawn so far has been presented
+internal void FinishFrames(FrameLoop *loop) {
+  for (int i = 0; i < kFrameBufferCount; ++i) {
+    PlatformWaitForSemaphore(&loop->free_buffers);
+  }
+  for (int i = 0; i < kFrameBufferCount; ++i) {
+    PlatformSignalSemaphore(&loop->free_buffers);
+  }
+}
+
+#endif  // RENDERER_FRAMES_CPP
@@ -97,6 +97,27 @@ inline int Abs(int value) {
     return -value;
 }
 
+inline int Min(int a, int b) { return (a < b) ? a : b; }
+
+inline int Max(int a, int b) { return (a > b) ? a : b; }
+
+inline i64 Min(i64 a, i64 b) { return (a < b) ? a : b; }
+
+inline i64 Max(i64 a, i64 b) { return (a > b) ? a : b; }
+
+inline r32 Min(r32 a, r32 b) { return (a < b) ? a : b; }
+
+inline r32 Max(r32 a, r32 b) { return (a > b) ? a : b; }
+
+inline int CountSetBits(u32 value) {
+#if defined(_MSC_VER)
+  int result = (int)__popcnt(value);
+#else
+  int result = __builtin_popcount(value);
+#endif
+  return result;
+}
+
 inline void swap_int(int *a, int *b) {
   int buffer = *a;
   *a = *b;
@@ -191,6 +212,29 @@ inline v2i &operator-=(v2i &a, v2i b) {
   return a;
 }
 
+// Integer rectangle, both corners inclusive
+
+struct Rect2i {
+  int min_x, min_y;
+  int max_x, max_y;
+};
+
+inline Rect2i Intersect(Rect2i a, Rect2i b) {
+  Rect2i result;
+
+  result.min_x = Max(a.min_x, b.min_x);
+  result.min_y = Max(a.min_y, b.min_y);
+  result.max_x = Min(a.max_x, b.max_x);
+  result.max_y = Min(a.max_y, b.max_y);
+
+  return result;
+}
+
+inline bool32 IsEmpty(Rect2i rect) {
+  bool32 result = rect.min_x > rect.max_x || rect.min_y > rect.max_y;
+  return result;
+}
+
 // Integer vector 3
 
 union v3i {
@@ -0,0 +1,106 @@
+#ifndef RENDERER_MEMORY_H
+#define RENDERER_MEMORY_H
+
+#include <string.h>
+
+// Memory arenas.
+//
+// The platform layer reserves two blocks once at startup, see GameMemory,
+// and everything else is pushed onto arenas made from them. Memory is
+// never freed piece by piece: an arena is cleared as a whole, or popped
+// back to where a TemporaryMemory scope began. Temporary scopes nest, and
+// must end in the reverse order.
+//
+// PushSize returns 0 when the arena is full, the memory is not cleared
+// unless it's a PushZero.
+
+struct MemoryArena {
+  u8 *base;
+  u64 size;
+  u64 used;
+  int temp_count;  // open temporary scopes
+};
+
+struct TemporaryMemory {
+  MemoryArena *arena;
+  u64 used;
+};
+
+#define Kilobytes(value) ((u64)(value) * 1024)
+#define Megabytes(value) (Kilobytes(value) * 1024)
+#define Gigabytes(value) (Megabytes(value) * 1024)
+
+const u64 kArenaAlignment = 64;  // a cache line, and enough for any SIMD
+
+inline void InitializeArena(MemoryArena *arena, void *base, u64 size) {
+  arena->base = (u8 *)base;
+  arena->size = size;
+  arena->used = 0;
+  arena->temp_count = 0;
+}
+
+inline void *PushSize(MemoryArena *arena, u64 size) {
+  u64 start = (arena->used + kArenaAlignment - 1) & ~(kArenaAlignment - 1);
+  if (start > arena->size || size > arena->size - start) return 0;
+
+  arena->used = start + size;
+  void *result = arena->base + start;
+  return result;
+}
+
+inline void *PushZeroSize(MemoryArena *arena, u64 size) {
+  void *result = PushSize(arena, size);
+  if (result) memset(result, 0, size);
+  return result;
+}
+
+#define PushStruct(arena, type) (type *)PushSize(arena, sizeof(type))
+#define PushArray(arena, count, type) \
+  (type *)PushSize(arena, (u64)(count) * sizeof(type))
+#define PushZeroArray(arena, count, type) \
+  (type *)PushZeroSize(arena, (u64)(count) * sizeof(type))
+
+// Carves an arena of the given size out of another one. Returns false if
+// it doesn't fit
+inline bool32 SubArena(MemoryArena *result, MemoryArena *arena, u64 size) {
+  void *base = PushSize(arena, size);
+  InitializeArena(result, base, base ? size : 0);
+  return base != 0;
+}
+
+inline void ClearArena(MemoryArena *arena) {
+  Assert(arena->temp_count == 0);
+  arena->used = 0;
+}
+
+inline TemporaryMemory BeginTemporaryMemory(MemoryArena *arena) {
+  TemporaryMemory result;
+  result.arena = arena;
+  result.used = arena->used;
+  arena->temp_count++;
+  return result;
+}
+
+inline void EndTemporaryMemory(TemporaryMemory temp) {
+  MemoryArena *arena = temp.arena;
+  Assert(arena->used >= temp.used);
+  Assert(arena->temp_count > 0);
+  arena->used = temp.used;
+  arena->temp_count--;
+}
+
+// Nothing may be left open at the end of a frame
+inline void CheckArena(MemoryArena *arena) {
+  Assert(arena->temp_count == 0);
+}
+
+// Reserved by the platform layer at startup, see InitializeRenderer
+struct GameMemory {
+  u64 permanent_storage_size;
+  void *permanent_storage;  // lives as long as the process
+
+  u64 transient_storage_size;
+  void *transient_storage;  // scratch for loads and frames
+};
+
+#endif  // RENDERER_MEMORY_H
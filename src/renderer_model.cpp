@@ -0,0 +1,605 @@
+#ifndef RENDERER_MODEL_CPP
+#define RENDERER_MODEL_CPP
+
+// Model loading.
+//
+// The text model is parsed once and written out next to it as a binary
+// cache (<model>.cache). Later loads map the cache and point the model
+// arrays straight into it, nothing is parsed or copied. The cache is
+// rebuilt when the text model is newer than the one it was made from, or
+// when it was made for a different face order.
+//
+// The cache is a ModelCacheHeader followed by the model arrays, each
+// starting at a multiple of kModelCacheAlignment.
+
+const u32 kModelCacheMagic = 'R' | 'M' << 8 | 'D' << 16 | 'L' << 24;
+// Bump whenever the header, ModelArrayType or any array element change
+const u32 kModelCacheVersion = 5;
+const u64 kModelCacheAlignment = 64;
+
+enum ModelArrayType {
+  ModelArray_Vertices,
+  ModelArray_Faces,
+  ModelArray_TextureCoords,
+  ModelArray_Normals,
+  ModelArray_FaceNormals,
+  ModelArray_Meshlets,
+  ModelArray_Edges,
+
+  ModelArray_Count
+};
+
+struct ModelCacheArray {
+  u64 offset;
+  u32 count;
+  u32 element_size;
+};
+
+struct ModelCacheHeader {
+  u32 magic;
+  u32 version;
+  u64 file_size;
+  u64 source_write_time;  // of the text model the cache was made from
+  u32 face_order;         // requested when the cache was made
+  r32 file_acmr;
+  r32 acmr;
+  u32 reserved;
+
+  ModelCacheArray arrays[ModelArray_Count];
+};
+
+// Where the model keeps an array and its count
+struct ModelArray {
+  void **memory;
+  int *count;
+  u32 element_size;
+};
+
+// Text model parser.
+//
+// The file is read in one go and split into chunks that end on a line
+// break. The chunks are parsed in two passes on the work queue. The first
+// one only counts what is in every chunk, the counts are prefix summed
+// into offsets, and the model arrays are pushed at their final size. The
+// second pass parses every chunk straight into the model at its offsets.
+// Relative (negative) face indices count back from what was parsed before
+// them, which the second pass knows from the offsets, and are made
+// absolute there. All indices are checked once the model is parsed.
+
+const u64 kModelChunkSize = 1024 * 1024;
+const int kMaxModelChunks = 64;
+
+struct ModelTextChunk {
+  char *start;
+  char *end;
+
+  int vert_count;
+  int tc_count;
+  int normal_count;
+  int face_count;
+
+  // Where the chunk goes in the model, filled in after counting
+  Model *model;
+  int vert_offset;
+  int tc_offset;
+  int normal_offset;
+  int face_offset;
+};
+
+global r64 g_powers_of_ten[] = {1e0,  1e1,  1e2,  1e3,  1e4,  1e5,
+                                1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+                                1e12, 1e13, 1e14, 1e15, 1e16, 1e17,
+                                1e18, 1e19, 1e20, 1e21, 1e22};
+
+inline bool32 IsModelSpace(char c) {
+  bool32 result = c == ' ' || c == '\t' || c == '\r';
+  return result;
+}
+
+inline bool32 IsDigit(char c) {
+  bool32 result = (u32)(c - '0') < 10;
+  return result;
+}
+
+inline char *SkipModelSpaces(char *at, char *end) {
+  while (at < end && IsModelSpace(*at)) ++at;
+  return at;
+}
+
+internal char *ParseModelInt(char *at, char *end, int *value) {
+  bool32 negative = false;
+  if (at < end && (*at == '-' || *at == '+')) {
+    negative = *at == '-';
+    ++at;
+  }
+
+  // Too many digits stick at INT_MAX, which no index is
+  int result = 0;
+  while (at < end && IsDigit(*at)) {
+    int digit = *at - '0';
+    result = result > (INT_MAX - digit) / 10 ? INT_MAX : result * 10 + digit;
+    ++at;
+  }
+
+  *value = negative ? -result : result;
+  return at;
+}
+
+// Decimal digits are gathered into an integer mantissa and scaled once by
+// a power of ten, which matches strtof for the short numbers models have
+internal char *ParseModelReal32(char *at, char *end, r32 *value) {
+  const u64 kMaxMantissa = 100000000000000000ull;  // room for one more digit
+
+  at = SkipModelSpaces(at, end);
+  bool32 negative = false;
+  if (at < end && (*at == '-' || *at == '+')) {
+    negative = *at == '-';
+    ++at;
+  }
+
+  u64 mantissa = 0;
+  int exponent = 0;
+  while (at < end && IsDigit(*at)) {
+    if (mantissa < kMaxMantissa) {
+      mantissa = mantissa * 10 + (*at - '0');
+    } else {
+      exponent++;
+    }
+    ++at;
+  }
+  if (at < end && *at == '.') {
+    ++at;
+    while (at < end && IsDigit(*at)) {
+      if (mantissa < kMaxMantissa) {
+        mantissa = mantissa * 10 + (*at - '0');
+        exponent--;
+      }
+      ++at;
+    }
+  }
+  if (at < end && (*at == 'e' || *at == 'E')) {
+    int explicit_exponent;
+    at = ParseModelInt(at + 1, end, &explicit_exponent);
+    exponent += explicit_exponent;
+  }
+
+  r64 result = (r64)mantissa;
+  int max_exponent = (int)COUNT_OF(g_powers_of_ten) - 1;
+  while (exponent < -max_exponent) {
+    result /= g_powers_of_ten[max_exponent];
+    exponent += max_exponent;
+  }
+  while (exponent > max_exponent) {
+    result *= g_powers_of_ten[max_exponent];
+    exponent -= max_exponent;
+  }
+  if (exponent < 0) {
+    result /= g_powers_of_ten[-exponent];
+  } else {
+    result *= g_powers_of_ten[exponent];
+  }
+
+  *value = (r32)(negative ? -result : result);
+  return at;
+}
+
+// Parses v, v/vt, v//vn or v/vt/vn
+internal char *ParseModelCorner(char *at, char *end, int *v, int *uv,
+                                int *normal) {
+  *uv = 0;
+  *normal = 0;
+  at = ParseModelInt(at, end, v);
+  if (at < end && *at == '/') {
+    ++at;
+    if (at < end && *at != '/') at = ParseModelInt(at, end, uv);
+    if (at < end && *at == '/') at = ParseModelInt(at + 1, end, normal);
+  }
+  return at;
+}
+
+// Relative indices are from count, the number of elements before them
+inline int GetAbsoluteIndex(int index, int count) {
+  int result = index < 0 ? count + 1 + index : index;
+  return result;
+}
+
+// Both passes go over the lines the same way, so the second one finds
+// exactly what the first one counted
+internal void ParseModelChunk(ModelTextChunk *chunk, bool32 count_only) {
+  Model *model = chunk->model;
+  char *at = chunk->start;
+  char *end = chunk->end;
+
+  int vert_count = 0;
+  int tc_count = 0;
+  int normal_count = 0;
+  int face_count = 0;
+  while (at < end) {
+    at = SkipModelSpaces(at, end);
+    char *line = at;
+    u64 length = end - at;
+
+    if (length > 1 && line[0] == 'v' && IsModelSpace(line[1])) {
+      // Vertices
+      if (!count_only) {
+        v3 *v = &model->vertices[chunk->vert_offset + vert_count];
+        at = ParseModelReal32(at + 1, end, &v->x);
+        at = ParseModelReal32(at, end, &v->y);
+        at = ParseModelReal32(at, end, &v->z);
+      }
+      vert_count++;
+    } else if (length > 2 && line[0] == 'v' && line[1] == 't' &&
+               IsModelSpace(line[2])) {
+      // Texture coordinates, the third one is ignored
+      if (!count_only) {
+        v2 *vt = &model->texture_coords[chunk->tc_offset + tc_count];
+        at = ParseModelReal32(at + 2, end, &vt->u);
+        at = ParseModelReal32(at, end, &vt->v);
+      }
+      tc_count++;
+    } else if (length > 2 && line[0] == 'v' && line[1] == 'n' &&
+               IsModelSpace(line[2])) {
+      // Vertex normals
+      if (!count_only) {
+        v3 *vn = &model->normals[chunk->normal_offset + normal_count];
+        at = ParseModelReal32(at + 2, end, &vn->x);
+        at = ParseModelReal32(at, end, &vn->y);
+        at = ParseModelReal32(at, end, &vn->z);
+      }
+      normal_count++;
+    } else if (length > 1 && line[0] == 'f' && IsModelSpace(line[1])) {
+      // Faces, polygons are split into a fan of triangles. The corners
+      // have to be parsed to be counted
+      Face face = {};
+      int corner_count = 0;
+      at++;
+      for (;;) {
+        at = SkipModelSpaces(at, end);
+        if (at == end || !(IsDigit(*at) || *at == '-' || *at == '+')) break;
+
+        int slot = Min(corner_count, 2);
+        at = ParseModelCorner(at, end, &face.v[slot], &face.uvs[slot],
+                              &face.normals[slot]);
+        corner_count++;
+
+        if (!count_only) {
+          face.v[slot] = GetAbsoluteIndex(face.v[slot],
+                                          chunk->vert_offset + vert_count);
+          face.uvs[slot] = GetAbsoluteIndex(face.uvs[slot],
+                                            chunk->tc_offset + tc_count);
+          face.normals[slot] = GetAbsoluteIndex(
+              face.normals[slot], chunk->normal_offset + normal_count);
+        }
+
+        if (corner_count >= 3) {
+          if (!count_only) {
+            model->faces[chunk->face_offset + face_count] = face;
+          }
+          face_count++;
+
+          // The next triangle shares the first and the last corner
+          face.v[1] = face.v[2];
+          face.uvs[1] = face.uvs[2];
+          face.normals[1] = face.normals[2];
+        }
+      }
+    }
+
+    // Anything else, and whatever is left of the line, is skipped
+    char *newline = (char *)memchr(at, '\n', end - at);
+    at = newline ? newline + 1 : end;
+  }
+
+  chunk->vert_count = vert_count;
+  chunk->tc_count = tc_count;
+  chunk->normal_count = normal_count;
+  chunk->face_count = face_count;
+}
+
+internal PLATFORM_WORK_QUEUE_CALLBACK(CountModelChunkWork) {
+  ParseModelChunk((ModelTextChunk *)data, true);
+}
+
+internal PLATFORM_WORK_QUEUE_CALLBACK(ParseModelChunkWork) {
+  ParseModelChunk((ModelTextChunk *)data, false);
+}
+
+internal void DoModelChunkWork(PlatformWorkQueueCallback *callback,
+                               ModelTextChunk *chunks, int chunk_count) {
+  if (!g_render_queue || chunk_count == 1) {
+    for (int i = 0; i < chunk_count; ++i) callback(0, &chunks[i]);
+    return;
+  }
+
+  for (int i = 0; i < chunk_count; ++i) {
+    PlatformAddWorkEntry(g_render_queue, callback, &chunks[i]);
+  }
+  PlatformCompleteAllWork(g_render_queue);
+}
+
+// Vertices have to be there, texture coordinates and normals are 0 when
+// the corner doesn't have them
+inline bool32 AreFaceIndicesValid(Face *face, Model *model) {
+  for (int j = 0; j < 3; ++j) {
+    if (face->v[j] < 1 || face->v[j] > model->vert_count) return false;
+    if (face->uvs[j] < 0 || face->uvs[j] > model->tc_count) return false;
+    if (face->normals[j] < 0 || face->normals[j] > model->normal_count) {
+      return false;
+    }
+  }
+  return true;
+}
+
+internal bool32 AreModelIndicesValid(Model *model) {
+  for (int i = 0; i < model->face_count; ++i) {
+    if (!AreFaceIndicesValid(&model->faces[i], model)) return false;
+  }
+  return true;
+}
+
+// The model arrays are pushed onto the model arena, the file is read into
+// temporary memory on the transient one
+internal bool32 ParseModelText(Model *model, MemoryArena *transient_arena,
+                               const char *filename) {
+  TemporaryMemory temp = BeginTemporaryMemory(transient_arena);
+  FileReadResult file = PlatformReadEntireFile(filename, transient_arena);
+  if (!file.memory) {
+    EndTemporaryMemory(temp);
+    return false;
+  }
+
+  char *text = (char *)file.memory;
+  char *text_end = text + file.memory_size;
+
+  // Split into chunks of about the same size, each ending after a newline
+  int chunk_count =
+      (int)((file.memory_size + kModelChunkSize - 1) / kModelChunkSize);
+  chunk_count = Max(1, Min(chunk_count, kMaxModelChunks));
+  u64 chunk_size = file.memory_size / chunk_count;
+
+  ModelTextChunk chunks[kMaxModelChunks] = {};
+  char *at = text;
+  for (int i = 0; i < chunk_count; ++i) {
+    chunks[i].model = model;
+    chunks[i].start = at;
+    if (i < chunk_count - 1) {
+      char *split = text + (i + 1) * chunk_size;
+      if (split < at) split = at;
+      char *newline = (char *)memchr(split, '\n', text_end - split);
+      at = newline ? newline + 1 : text_end;
+    } else {
+      at = text_end;
+    }
+    chunks[i].end = at;
+  }
+
+  DoModelChunkWork(CountModelChunkWork, chunks, chunk_count);
+
+  // Prefix sum of the counts gives where each chunk goes
+  for (int i = 0; i < chunk_count; ++i) {
+    ModelTextChunk *chunk = &chunks[i];
+    chunk->vert_offset = model->vert_count;
+    chunk->tc_offset = model->tc_count;
+    chunk->normal_offset = model->normal_count;
+    chunk->face_offset = model->face_count;
+    model->vert_count += chunk->vert_count;
+    model->tc_count += chunk->tc_count;
+    model->normal_count += chunk->normal_count;
+    model->face_count += chunk->face_count;
+  }
+
+  MemoryArena *arena = &model->arena;
+  model->vertices = PushArray(arena, model->vert_count, v3);
+  model->texture_coords = PushArray(arena, model->tc_count, v2);
+  model->normals = PushArray(arena, model->normal_count, v3);
+  model->faces = PushArray(arena, model->face_count, Face);
+  bool32 result = model->vertices && model->texture_coords &&
+                  model->normals && model->faces;
+
+  if (result) DoModelChunkWork(ParseModelChunkWork, chunks, chunk_count);
+  if (result) result = AreModelIndicesValid(model);
+
+  EndTemporaryMemory(temp);
+  return result;
+}
+
+inline u64 AlignUp(u64 value, u64 alignment) {
+  u64 result = (value + alignment - 1) & ~(alignment - 1);
+  return result;
+}
+
+internal void GetModelArrays(Model *model, ModelArray *arrays) {
+  ModelArray result[ModelArray_Count] = {
+      {(void **)&model->vertices, &model->vert_count, sizeof(v3)},
+      {(void **)&model->faces, &model->face_count, sizeof(Face)},
+      {(void **)&model->texture_coords, &model->tc_count, sizeof(v2)},
+      {(void **)&model->normals, &model->normal_count, sizeof(v3)},
+      {(void **)&model->face_normals, &model->face_count, sizeof(v3)},
+      {(void **)&model->meshlets, &model->meshlet_count, sizeof(Meshlet)},
+      {(void **)&model->edges, &model->edge_count, sizeof(Edge)},
+  };
+  memcpy(arrays, result, sizeof(result));
+}
+
+inline bool32 IsCacheArrayValid(ModelCacheHeader *header,
+                                ModelCacheArray *array, u32 element_size) {
+  bool32 result = array->element_size == element_size &&
+                  array->offset % kModelCacheAlignment == 0 &&
+                  array->offset >= sizeof(ModelCacheHeader) &&
+                  array->offset <= header->file_size &&
+                  array->count <=
+                      (header->file_size - array->offset) / element_size;
+  return result;
+}
+
+// Maps the cache into the model if it's there and up to date.
+// source_write_time of 0 means the text model is missing, and any cache
+// will do
+internal bool32 LoadModelCache(Model *model, const char *cache_filename,
+                               u64 source_write_time,
+                               FaceOrder face_order) {
+  FileReadResult file = PlatformMapFile(cache_filename);
+  if (!file.memory) return false;
+
+  ModelCacheHeader *header = (ModelCacheHeader *)file.memory;
+  bool32 is_valid =
+      file.memory_size >= sizeof(ModelCacheHeader) &&
+      header->magic == kModelCacheMagic &&
+      header->version == kModelCacheVersion &&
+      header->file_size == file.memory_size &&
+      (source_write_time == 0 ||
+       header->source_write_time == source_write_time) &&
+      header->face_order == (u32)face_order &&
+      header->arrays[ModelArray_FaceNormals].count ==
+          header->arrays[ModelArray_Faces].count;
+
+  ModelArray arrays[ModelArray_Count];
+  GetModelArrays(model, arrays);
+  for (int i = 0; is_valid && i < ModelArray_Count; ++i) {
+    is_valid = IsCacheArrayValid(header, &header->arrays[i],
+                                 arrays[i].element_size);
+  }
+  if (!is_valid) {
+    PlatformUnmapFile(&file);
+    return false;
+  }
+
+  for (int i = 0; i < ModelArray_Count; ++i) {
+    *arrays[i].memory = (u8 *)file.memory + header->arrays[i].offset;
+    *arrays[i].count = header->arrays[i].count;
+  }
+
+  // Nothing is drawn from indices that aren't checked, whoever wrote the
+  // file
+  is_valid = AreModelIndicesValid(model);
+  for (int i = 0; is_valid && i < model->meshlet_count; ++i) {
+    Meshlet *meshlet = &model->meshlets[i];
+    is_valid = meshlet->first_face >= 0 && meshlet->face_count >= 0 &&
+               meshlet->face_count <= model->face_count - meshlet->first_face;
+  }
+  for (int i = 0; is_valid && i < model->edge_count; ++i) {
+    Edge *edge = &model->edges[i];
+    is_valid = (u32)edge->v[0] < (u32)model->vert_count &&
+               (u32)edge->v[1] < (u32)model->vert_count;
+  }
+  if (!is_valid) {
+    for (int i = 0; i < ModelArray_Count; ++i) {
+      *arrays[i].memory = 0;
+      *arrays[i].count = 0;
+    }
+    PlatformUnmapFile(&file);
+    return false;
+  }
+
+  model->face_order = (FaceOrder)header->face_order;
+  model->file_acmr = header->file_acmr;
+  model->acmr = header->acmr;
+  model->cache_file = file;
+
+  return true;
+}
+
+// The file is put together in temporary memory on the arena
+internal void WriteModelCache(Model *model, MemoryArena *arena,
+                              const char *cache_filename,
+                              u64 source_write_time, FaceOrder face_order) {
+  ModelCacheHeader header = {};
+  header.magic = kModelCacheMagic;
+  header.version = kModelCacheVersion;
+  header.source_write_time = source_write_time;
+  header.face_order = face_order;
+  header.file_acmr = model->file_acmr;
+  header.acmr = model->acmr;
+
+  ModelArray arrays[ModelArray_Count];
+  GetModelArrays(model, arrays);
+  u64 file_size = sizeof(ModelCacheHeader);
+  for (int i = 0; i < ModelArray_Count; ++i) {
+    ModelCacheArray *array = &header.arrays[i];
+    array->offset = AlignUp(file_size, kModelCacheAlignment);
+    array->count = *arrays[i].count;
+    array->element_size = arrays[i].element_size;
+    file_size = array->offset + (u64)array->count * array->element_size;
+  }
+  header.file_size = file_size;
+
+  // Zeroed, so the padding is deterministic
+  TemporaryMemory temp = BeginTemporaryMemory(arena);
+  u8 *memory = (u8 *)PushZeroSize(arena, file_size);
+  if (!memory) {
+    EndTemporaryMemory(temp);
+    return;
+  }
+
+  memcpy(memory, &header, sizeof(header));
+  for (int i = 0; i < ModelArray_Count; ++i) {
+    ModelCacheArray *array = &header.arrays[i];
+    memcpy(memory + array->offset, *arrays[i].memory,
+           (u64)array->count * array->element_size);
+  }
+
+  // Failing to write the cache only costs the next load a parse
+  PlatformWriteEntireFile(cache_filename, memory, file_size);
+  EndTemporaryMemory(temp);
+}
+
+// Releases everything the model owns, its arena is kept for the next load
+internal void UnloadModel(Model *model) {
+  PlatformUnmapFile(&model->cache_file);
+  ClearArena(&model->arena);
+
+  MemoryArena arena = model->arena;
+  u32 version = model->version;
+  *model = {};
+  model->arena = arena;
+  model->version = version;
+}
+
+// Replaces whatever the model held before. Everything it keeps goes onto
+// its own arena, and the scratch of the load is temporary memory on the
+// transient arena. Returns false if the model or its indices aren't
+// valid, the model is empty then
+internal bool32 LoadModelFromFile(Model *model, MemoryArena *transient_arena,
+                                const char *filename,
+                                const char *texture_filename,
+                                FaceOrder face_order) {
+  TIMED_BLOCK(LoadModel);
+  UnloadModel(model);
+
+  // Load texture, the model is drawn untextured without it
+  {
+    TGAImage image;
+    image.read_tga_file(texture_filename);
+    image.flip_vertically();
+    if (!LoadTexture(&model->diffuse, &model->arena, &image)) {
+      model->diffuse = {};
+    }
+  }
+
+  // Load model
+  char cache_filename[512];
+  snprintf(cache_filename, sizeof(cache_filename), "%s.cache", filename);
+  u64 source_write_time = PlatformGetLastWriteTime(filename);
+
+  if (LoadModelCache(model, cache_filename, source_write_time, face_order)) {
+    model->is_loaded = true;
+  } else if (ParseModelText(model, transient_arena, filename)) {
+    OptimizeModel(model, transient_arena, face_order);
+    if (ComputeFaceNormals(model) && BuildMeshlets(model) &&
+        BuildEdges(model, transient_arena)) {
+      WriteModelCache(model, transient_arena, cache_filename,
+                      source_write_time, face_order);
+      model->is_loaded = true;
+    }
+  }
+
+  if (model->is_loaded) {
+    // Frames drawn from the old data are out of date
+    model->version++;
+  } else {
+    UnloadModel(model);
+  }
+  return model->is_loaded;
+}
+
+#endif  // RENDERER_MODEL_CPP
@@ -0,0 +1,511 @@
+#ifndef RENDERER_OPTIMIZE_CPP
+#define RENDERER_OPTIMIZE_CPP
+
+// Load-time mesh processing.
+//
+// Faces are reordered with Tipsify (Sander, Nehab, Barczak: "Fast Triangle
+// Reordering for Vertex Locality and Reduced Overdraw"), which fans around
+// vertices that are still in a simulated FIFO vertex cache. Vertices,
+// texture coordinates and normals are then put in the order the faces
+// first use them, so walking the faces walks the attribute arrays mostly
+// forward.
+//
+// Optionally the reordered faces are cut into clusters that are sorted
+// front to back for the fixed view (larger z is closer), trading a little
+// locality for less overdraw.
+//
+// The quality measure is the ACMR, average cache miss ratio: vertices
+// that miss a FIFO cache of kVertexCacheSize per face. 0.5 is the best
+// possible on a large closed mesh, 3 is the worst.
+//
+// After reordering, the face normals are computed once, and consecutive
+// faces are grouped into meshlets that can be culled with one test. The
+// edges the faces share are listed once, for the wireframe.
+
+const int kVertexCacheSize = 16;
+const int kFrontToBackClusterSize = 64;  // faces
+const int kMeshletSize = 64;             // faces, at most
+const r32 kMeshletMinNormalCos = 0.5f;   // 60 degrees from the average
+
+struct FaceCluster {
+  r32 z;  // average of the face centroids
+  int first_face;
+  int face_count;
+};
+
+internal r32 GetACMR(Face *faces, int face_count, int vert_count,
+                     int cache_size, MemoryArena *arena) {
+  if (face_count == 0) return 0;
+
+  // Vertex is in the cache when fewer than cache_size misses happened
+  // since it was put in. 0 is never put in
+  TemporaryMemory temp = BeginTemporaryMemory(arena);
+  int *put_in_at = PushZeroArray(arena, vert_count, int);
+  if (!put_in_at) {
+    EndTemporaryMemory(temp);
+    return 0;
+  }
+  int miss_count = 0;
+  for (int i = 0; i < face_count; ++i) {
+    for (int j = 0; j < 3; ++j) {
+      int v = faces[i].v[j] - 1;
+      if (!put_in_at[v] || miss_count - put_in_at[v] >= cache_size) {
+        miss_count++;
+        put_in_at[v] = miss_count;
+      }
+    }
+  }
+  EndTemporaryMemory(temp);
+
+  r32 result = (r32)miss_count / face_count;
+  return result;
+}
+
+// Next vertex to fan around when the candidates are all used up: the
+// last one that was visited and still has faces left, or failing that
+// the next one in index order. -1 when all faces are out
+internal int SkipDeadEnd(int *live_count, int *dead_end_stack,
+                         int *dead_end_count, int *cursor, int vert_count) {
+  while (*dead_end_count > 0) {
+    int v = dead_end_stack[--*dead_end_count];
+    if (live_count[v] > 0) return v;
+  }
+  while (*cursor < vert_count) {
+    int v = (*cursor)++;
+    if (live_count[v] > 0) return v;
+  }
+  return -1;
+}
+
+// Reorders faces with Tipsify. Indices must be valid. Returns false and
+// leaves the faces alone if the scratch doesn't fit in the arena
+internal bool32 TipsifyFaces(Face *faces, int face_count, int vert_count,
+                             int cache_size, MemoryArena *arena) {
+  u64 int_count = (u64)(vert_count + 1)  // face_offsets
+                  + 3 * face_count       // vertex_faces
+                  + vert_count           // live_count
+                  + vert_count           // cache_time
+                  + 3 * face_count       // dead_end_stack
+                  + 3 * face_count       // candidates
+                  + face_count;          // emitted
+  u64 memory_size = sizeof(int) * int_count + sizeof(Face) * face_count;
+  TemporaryMemory temp = BeginTemporaryMemory(arena);
+  int *memory = (int *)PushZeroSize(arena, memory_size);
+  if (!memory) {
+    EndTemporaryMemory(temp);
+    return false;
+  }
+
+  int *face_offsets = memory;
+  int *vertex_faces = face_offsets + vert_count + 1;
+  int *live_count = vertex_faces + 3 * face_count;
+  int *cache_time = live_count + vert_count;
+  int *dead_end_stack = cache_time + vert_count;
+  int *candidates = dead_end_stack + 3 * face_count;
+  int *emitted = candidates + 3 * face_count;
+  Face *sorted = (Face *)(emitted + face_count);
+
+  // Faces around every vertex, counted, prefix summed, then filled
+  for (int i = 0; i < face_count; ++i) {
+    for (int j = 0; j < 3; ++j) live_count[faces[i].v[j] - 1]++;
+  }
+  for (int v = 0; v < vert_count; ++v) {
+    face_offsets[v + 1] = face_offsets[v] + live_count[v];
+    cache_time[v] = face_offsets[v];  // used as a fill cursor for now
+  }
+  for (int i = 0; i < face_count; ++i) {
+    for (int j = 0; j < 3; ++j) {
+      int v = faces[i].v[j] - 1;
+      vertex_faces[cache_time[v]++] = i;
+    }
+  }
+  for (int v = 0; v < vert_count; ++v) cache_time[v] = 0;
+
+  int time_stamp = cache_size + 1;
+  int dead_end_count = 0;
+  int cursor = 1;
+  int sorted_count = 0;
+
+  int fanning = face_count > 0 ? 0 : -1;
+  while (fanning >= 0) {
+    // Emit every face around the fanning vertex that isn't out yet
+    int candidate_count = 0;
+    for (int i = face_offsets[fanning]; i < face_offsets[fanning + 1]; ++i) {
+      int face_index = vertex_faces[i];
+      if (emitted[face_index]) continue;
+
+      Face *face = &faces[face_index];
+      for (int j = 0; j < 3; ++j) {
+        int v = face->v[j] - 1;
+        dead_end_stack[dead_end_count++] = v;
+        candidates[candidate_count++] = v;
+        live_count[v]--;
+        if (time_stamp - cache_time[v] > cache_size) {
+          cache_time[v] = time_stamp++;
+        }
+      }
+      emitted[face_index] = true;
+      sorted[sorted_count++] = *face;
+    }
+
+    // Fan next around the candidate that stays in the cache the longest,
+    // as long as its remaining faces won't push it out
+    int best = -1;
+    int best_priority = -1;
+    for (int i = 0; i < candidate_count; ++i) {
+      int v = candidates[i];
+      if (live_count[v] <= 0) continue;
+
+      int priority = 0;
+      if (time_stamp - cache_time[v] + 2 * live_count[v] <= cache_size) {
+        priority = time_stamp - cache_time[v];
+      }
+      if (priority > best_priority) {
+        best_priority = priority;
+        best = v;
+      }
+    }
+    if (best == -1) {
+      best = SkipDeadEnd(live_count, dead_end_stack, &dead_end_count, &cursor,
+                         vert_count);
+    }
+    fanning = best;
+  }
+  Assert(sorted_count == face_count);
+
+  memcpy(faces, sorted, sizeof(Face) * face_count);
+  EndTemporaryMemory(temp);
+  return true;
+}
+
+internal int CompareFaceClusters(const void *a, const void *b) {
+  r32 z_a = ((FaceCluster *)a)->z;
+  r32 z_b = ((FaceCluster *)b)->z;
+  // Closest first, and keep the order of equal ones stable
+  if (z_a != z_b) return z_a > z_b ? -1 : 1;
+  return ((FaceCluster *)a)->first_face - ((FaceCluster *)b)->first_face;
+}
+
+// Returns false and leaves the faces alone if the scratch doesn't fit in
+// the arena
+internal bool32 SortFaceClustersFrontToBack(Model *model,
+                                            MemoryArena *arena) {
+  int cluster_count = (model->face_count + kFrontToBackClusterSize - 1) /
+                      kFrontToBackClusterSize;
+  u64 memory_size = sizeof(FaceCluster) * cluster_count +
+                    sizeof(Face) * model->face_count;
+  TemporaryMemory temp = BeginTemporaryMemory(arena);
+  FaceCluster *clusters = (FaceCluster *)PushSize(arena, memory_size);
+  if (!clusters) {
+    EndTemporaryMemory(temp);
+    return false;
+  }
+  Face *sorted = (Face *)(clusters + cluster_count);
+
+  for (int i = 0; i < cluster_count; ++i) {
+    FaceCluster *cluster = &clusters[i];
+    cluster->first_face = i * kFrontToBackClusterSize;
+    cluster->face_count = Min(kFrontToBackClusterSize,
+                              model->face_count - cluster->first_face);
+    r32 z_sum = 0;
+    for (int f = 0; f < cluster->face_count; ++f) {
+      Face *face = &model->faces[cluster->first_face + f];
+      for (int j = 0; j < 3; ++j) z_sum += model->vertices[face->v[j] - 1].z;
+    }
+    cluster->z = z_sum / (3 * cluster->face_count);
+  }
+  qsort(clusters, cluster_count, sizeof(FaceCluster), CompareFaceClusters);
+
+  Face *out = sorted;
+  for (int i = 0; i < cluster_count; ++i) {
+    memcpy(out, model->faces + clusters[i].first_face,
+           sizeof(Face) * clusters[i].face_count);
+    out += clusters[i].face_count;
+  }
+  memcpy(model->faces, sorted, sizeof(Face) * model->face_count);
+
+  EndTemporaryMemory(temp);
+  return true;
+}
+
+// Puts the attributes in the order the faces first use them, and remaps
+// the face indices found at index_offset in Face. Unused attributes go
+// to the end. Skipped if the scratch doesn't fit in the arena
+internal void ReorderAttributes(Face *faces, int face_count,
+                                size_t index_offset, void *attributes,
+                                int count, int element_size,
+                                MemoryArena *arena) {
+  if (count == 0) return;
+
+  u64 memory_size = sizeof(int) * count + (u64)element_size * count;
+  TemporaryMemory temp = BeginTemporaryMemory(arena);
+  int *new_index = (int *)PushZeroSize(arena, memory_size);  // 1-based
+  if (!new_index) {
+    EndTemporaryMemory(temp);
+    return;
+  }
+  u8 *reordered = (u8 *)(new_index + count);
+
+  int next_index = 0;
+  for (int i = 0; i < face_count; ++i) {
+    int *indices = (int *)((u8 *)&faces[i] + index_offset);
+    for (int j = 0; j < 3; ++j) {
+      int old_index = indices[j] - 1;
+      if (old_index < 0) continue;  // missing
+      if (!new_index[old_index]) new_index[old_index] = ++next_index;
+      indices[j] = new_index[old_index];
+    }
+  }
+  for (int i = 0; i < count; ++i) {
+    if (!new_index[i]) new_index[i] = ++next_index;
+  }
+
+  for (int i = 0; i < count; ++i) {
+    memcpy(reordered + (u64)(new_index[i] - 1) * element_size,
+           (u8 *)attributes + (u64)i * element_size, element_size);
+  }
+  memcpy(attributes, reordered, (u64)element_size * count);
+
+  EndTemporaryMemory(temp);
+}
+
+// Reorders a freshly parsed model, the arrays must be writable and the
+// face indices valid. The scratch is temporary memory on the arena
+internal void OptimizeModel(Model *model, MemoryArena *arena,
+                            FaceOrder order) {
+  model->face_order = FaceOrder_File;
+  model->file_acmr = model->acmr = 0;
+
+  model->file_acmr = GetACMR(model->faces, model->face_count,
+                             model->vert_count, kVertexCacheSize, arena);
+  model->acmr = model->file_acmr;
+  if (order == FaceOrder_File) return;
+
+  if (!TipsifyFaces(model->faces, model->face_count, model->vert_count,
+                    kVertexCacheSize, arena)) {
+    return;
+  }
+  if (order == FaceOrder_FrontToBack &&
+      !SortFaceClustersFrontToBack(model, arena)) {
+    order = FaceOrder_Locality;
+  }
+
+  ReorderAttributes(model->faces, model->face_count, offsetof(Face, v),
+                    model->vertices, model->vert_count, sizeof(v3), arena);
+  ReorderAttributes(model->faces, model->face_count, offsetof(Face, uvs),
+                    model->texture_coords, model->tc_count, sizeof(v2),
+                    arena);
+  ReorderAttributes(model->faces, model->face_count, offsetof(Face, normals),
+                    model->normals, model->normal_count, sizeof(v3), arena);
+
+  model->face_order = order;
+  model->acmr = GetACMR(model->faces, model->face_count, model->vert_count,
+                        kVertexCacheSize, arena);
+}
+
+// Same normal the faces used to compute every frame. Returns false if
+// they don't fit in the model arena
+internal bool32 ComputeFaceNormals(Model *model) {
+  model->face_normals = PushArray(&model->arena, model->face_count, v3);
+  if (!model->face_normals) return false;
+  for (int i = 0; i < model->face_count; ++i) {
+    Face *face = &model->faces[i];
+    v3 vert[3];
+    for (int j = 0; j < 3; ++j) {
+      vert[j] = model->vertices[face->v[j] - 1];
+    }
+    model->face_normals[i] =
+        Normalize(CrossProduct(vert[2] - vert[0], vert[1] - vert[0]));
+  }
+  return true;
+}
+
+// A meshlet ends after kMeshletSize faces, or before a face whose normal
+// is too far from the average so far, which keeps the cone narrow enough
+// to be culled
+internal int GetMeshletEnd(Model *model, int first_face) {
+  int end_face = Min(first_face + kMeshletSize, model->face_count);
+  v3 normal_sum = model->face_normals[first_face];
+  for (int i = first_face + 1; i < end_face; ++i) {
+    v3 n = model->face_normals[i];
+    if (DotProduct(Normalize(normal_sum), n) < kMeshletMinNormalCos) {
+      return i;
+    }
+    normal_sum += n;
+  }
+  return end_face;
+}
+
+// Needs the face normals. Returns false if the meshlets don't fit in the
+// model arena
+internal bool32 BuildMeshlets(Model *model) {
+  model->meshlet_count = 0;
+  for (int i = 0; i < model->face_count; i = GetMeshletEnd(model, i)) {
+    model->meshlet_count++;
+  }
+  model->meshlets = PushArray(&model->arena, model->meshlet_count, Meshlet);
+  if (!model->meshlets) return false;
+
+  int first_face = 0;
+  for (int m = 0; m < model->meshlet_count; ++m) {
+    Meshlet *meshlet = &model->meshlets[m];
+    meshlet->first_face = first_face;
+    first_face = GetMeshletEnd(model, first_face);
+    meshlet->face_count = first_face - meshlet->first_face;
+    Face *faces = model->faces + meshlet->first_face;
+    v3 *normals = model->face_normals + meshlet->first_face;
+
+    // Sphere around the center of the bounding box
+    v3 box_min = {FLT_MAX, FLT_MAX, FLT_MAX};
+    v3 box_max = {-FLT_MAX, -FLT_MAX, -FLT_MAX};
+    for (int i = 0; i < meshlet->face_count; ++i) {
+      for (int j = 0; j < 3; ++j) {
+        v3 vert = model->vertices[faces[i].v[j] - 1];
+        for (int k = 0; k < 3; ++k) {
+          box_min.e[k] = Min(box_min.e[k], vert.e[k]);
+          box_max.e[k] = Max(box_max.e[k], vert.e[k]);
+        }
+      }
+    }
+    meshlet->center = 0.5f * (box_min + box_max);
+    meshlet->radius = 0;
+    for (int i = 0; i < meshlet->face_count; ++i) {
+      for (int j = 0; j < 3; ++j) {
+        v3 vert = model->vertices[faces[i].v[j] - 1];
+        meshlet->radius =
+            Max(meshlet->radius, V3Length(vert - meshlet->center));
+      }
+    }
+
+    // Cone around the average normal. Degenerate faces have NaN normals
+    // and are drawn anyway, so they leave the cone open
+    v3 normal_sum = {};
+    bool32 has_cone = true;
+    for (int i = 0; i < meshlet->face_count; ++i) {
+      v3 n = normals[i];
+      if (n.x != n.x || n.y != n.y || n.z != n.z) has_cone = false;
+      normal_sum += n;
+    }
+    meshlet->cone_axis = {};
+    meshlet->cone_sin = 2.0f;
+    if (has_cone && V3Length(normal_sum) > 0) {
+      meshlet->cone_axis = Normalize(normal_sum);
+      r32 min_cos = 1.0f;
+      for (int i = 0; i < meshlet->face_count; ++i) {
+        min_cos = Min(min_cos, DotProduct(meshlet->cone_axis, normals[i]));
+      }
+      // Wider than 90 degrees can't be culled
+      if (min_cos > 0) {
+        meshlet->cone_sin = SquareRoot(1.0f - min_cos * min_cos);
+      }
+    }
+  }
+  return true;
+}
+
+internal int CompareInts(const void *a, const void *b) {
+  int result = *(int *)a - *(int *)b;
+  return result;
+}
+
+// Sorts the other ends of the edges of one vertex. Most vertices have a
+// handful, the poles of a sphere have thousands
+internal void SortEdgeEnds(int *ends, int count) {
+  if (count > 16) {
+    qsort(ends, count, sizeof(int), CompareInts);
+    return;
+  }
+  for (int i = 1; i < count; ++i) {
+    int end = ends[i];
+    int j = i;
+    for (; j > 0 && ends[j - 1] > end; --j) ends[j] = ends[j - 1];
+    ends[j] = end;
+  }
+}
+
+// Edge j of the face as 0-based vertex indices, lo < hi. False for the
+// edges that collapse to a point or have a vertex out of range
+inline bool32 GetFaceEdge(Model *model, int face_index, int j, int *lo,
+                          int *hi) {
+  int *v = model->faces[face_index].v;
+  int a = v[j] - 1;
+  int b = v[j == 2 ? 0 : j + 1] - 1;
+  *lo = Min(a, b);
+  *hi = Max(a, b);
+  bool32 result = *lo >= 0 && *hi < model->vert_count && a != b;
+  return result;
+}
+
+// Every edge of the faces once, ordered by the lower vertex and then the
+// higher one. The edges are bucketed by their lower vertex like the
+// triangles are binned into tiles, count, prefix sum and fill, and each
+// bucket is deduplicated on its own. The scratch is temporary memory on
+// the arena. Returns false if something doesn't fit
+internal bool32 BuildEdges(Model *model, MemoryArena *arena) {
+  model->edges = 0;
+  model->edge_count = 0;
+
+  TemporaryMemory temp = BeginTemporaryMemory(arena);
+  int *offsets = PushZeroArray(arena, model->vert_count + 1, int);
+  int *ends = PushArray(arena, 3 * model->face_count, int);
+  bool32 result = offsets && ends;
+
+  if (result) {
+    for (int i = 0; i < model->face_count; ++i) {
+      for (int j = 0; j < 3; ++j) {
+        int lo, hi;
+        if (GetFaceEdge(model, i, j, &lo, &hi)) offsets[lo + 1]++;
+      }
+    }
+    for (int i = 0; i < model->vert_count; ++i) {
+      offsets[i + 1] += offsets[i];
+    }
+
+    // offsets[i] is where the ends of vertex i go, the fill moves it up to
+    // the start of vertex i + 1
+    for (int i = 0; i < model->face_count; ++i) {
+      for (int j = 0; j < 3; ++j) {
+        int lo, hi;
+        if (GetFaceEdge(model, i, j, &lo, &hi)) ends[offsets[lo]++] = hi;
+      }
+    }
+
+    // The unique ends are packed to the front of the array, in order, and
+    // offsets[i] becomes the unique count of vertex i
+    int start = 0;
+    for (int i = 0; i < model->vert_count; ++i) {
+      int end = offsets[i];
+      SortEdgeEnds(ends + start, end - start);
+      int *unique = ends + model->edge_count;
+      int unique_count = 0;
+      for (int j = start; j < end; ++j) {
+        if (unique_count == 0 || ends[j] != unique[unique_count - 1]) {
+          unique[unique_count++] = ends[j];
+        }
+      }
+      offsets[i] = unique_count;
+      model->edge_count += unique_count;
+      start = end;
+    }
+
+    model->edges = PushArray(&model->arena, model->edge_count, Edge);
+    result = model->edges != 0;
+  }
+
+  if (result) {
+    Edge *edge = model->edges;
+    int *end = ends;
+    for (int i = 0; i < model->vert_count; ++i) {
+      for (int j = 0; j < offsets[i]; ++j) {
+        edge->v[0] = i;
+        edge->v[1] = *end++;
+        edge++;
+      }
+    }
+  }
+
+  EndTemporaryMemory(temp);
+  return result;
+}
+
+#endif  // RENDERER_OPTIMIZE_CPP
@@ -30,7 +30,48 @@ typedef i32 bool32;
 #define Assert(Expression)
 #endif
 
+#if defined(_MSC_VER)
+#define ALIGN16 __declspec(align(16))
+#else
+#define ALIGN16 __attribute__((aligned(16)))
+#endif
+
 #define COUNT_OF(x) ((sizeof(x)/sizeof(0[x])) / ((size_t)(!(sizeof(x) % sizeof(0[x])))))
 
+// Atomics return the value from before the operation
+#if defined(_MSC_VER)
+#include <intrin.h>
+inline i32 AtomicAddI32(i32 volatile *value, i32 addend) {
+  i32 result = _InterlockedExchangeAdd((long volatile *)value, addend);
+  return result;
+}
+#else
+inline i32 AtomicAddI32(i32 volatile *value, i32 addend) {
+  i32 result = __sync_fetch_and_add(value, addend);
+  return result;
+}
+#endif
+
+// Work queue, implemented by the platform layer.
+// Entries are picked up by the worker threads, and the thread calling
+// PlatformCompleteAllWork helps out until the queue is empty.
+struct PlatformWorkQueue;
+
+// Drawing adds one entry per thread at a time, and a full ring would
+// overwrite the oldest, so there are kMaxThreadCount threads at most
+const int kPlatformWorkQueueSize = 256;
+const int kMaxThreadCount = kPlatformWorkQueueSize - 1;
+
+#define PLATFORM_WORK_QUEUE_CALLBACK(name) \
+  void name(PlatformWorkQueue *queue, void *data)
+typedef PLATFORM_WORK_QUEUE_CALLBACK(PlatformWorkQueueCallback);
+
+// Threads and semaphores, implemented by the platform layer along with
+// PlatformSemaphore. Used where a thread has to wait without spinning
+struct PlatformSemaphore;
+
+#define PLATFORM_THREAD_PROC(name) void name(void *data)
+typedef PLATFORM_THREAD_PROC(PlatformThreadProc);
+
 
 #endif  // RENDERER_PLATFORM_H
\ No newline at end of file
@@ -0,0 +1,999 @@
+#ifndef RENDERER_RASTER_CPP
+#define RENDERER_RASTER_CPP
+
+// Half-space (edge function) rasterizer.
+// The bounding box is walked in 8x8 blocks. Blocks that are fully outside
+// one of the edges are skipped, blocks fully inside all three edges are
+// filled without testing the edges per pixel.
+
+// Vertices are either whole pixels, sampled at the pixel corner and with
+// shared edges drawn by both triangles, or fixed point with subpixel bits
+// and sampled at the pixel center. In fixed point the edges follow the
+// top-left rule: a pixel center exactly on an edge belongs to the triangle
+// that has it on a top or left edge, so a closed mesh draws every pixel of
+// its surface once. The edge setup is all integer either way.
+
+// The attributes are planes over the screen, set up once per triangle.
+// At the start of a block row they're evaluated directly, and from there
+// every pixel adds its precomputed offset from the row start, so the pixel
+// kernels only add. Texture coordinates are either affine, or divided by
+// an interpolated 1/w per pixel to correct for the perspective.
+
+// The pixel kernels process a row of up to 8 pixels, 4 or 8 at a time
+// when SSE2 or AVX2 are available. They are bit-identical to the scalar
+// kernel: the same float operations are done in the same order per lane.
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define RASTER_SIMD_WIDTH 8
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define RASTER_SIMD_WIDTH 4
+#else
+#define RASTER_SIMD_WIDTH 1
+#endif
+
+// Blocks line up with the hierarchical depth blocks
+const int kBlockSize = kDepthBlockSize;
+
+// 28.4 fixed point for Rasterizer_Subpixel
+const int kSubpixelBits = 4;
+
+// Screen positions are clamped to this many pixels either way, vertices
+// far off the screen move in to it
+const int kScreenGuardBand = 1 << 16;
+
+// What a draw does per pixel. Each combination has its own rasterizer
+enum RasterState {
+  RasterState_DepthTest = 1 << 0,
+  RasterState_DepthWrite = 1 << 1,
+  RasterState_Textured = 1 << 2,     // solid color otherwise
+  RasterState_Gouraud = 1 << 3,      // flat intensity otherwise
+  RasterState_Blend = 1 << 4,        // over the color buffer by alpha
+  RasterState_Perspective = 1 << 5,  // perspective correct texturing
+
+  RasterState_Count = 1 << 6,
+
+  // Write tri->id instead of shading, or no color at all. Only for the
+  // passes of the same name
+  RasterState_TriangleId = 1 << 6,
+  RasterState_DepthOnly = 1 << 7,
+};
+
+// What RasterizeHalfSpaceTriangle draws. The passes other than Shade
+// ignore the state of the triangle
+enum RasterPass {
+  RasterPass_Shade,       // by the triangle's state
+  RasterPass_TriangleId,  // depth and tri->id, see renderer_visibility.cpp
+  RasterPass_DepthOnly,   // depth, for a prepass or a shadow map
+};
+
+struct PipelineState {
+  u32 flags;  // RasterState
+  u32 color;  // when not textured
+  r32 alpha;  // when blended
+  Texture *texture;
+  int subpixel_bits;
+};
+
+// A face looked up in the screen vertices
+struct AssembledFace {
+  v3i p[3];
+  v2i uv[3];
+  r32 inv_w[3];
+  r32 vertex_intensity[3];  // only for Gouraud shading
+  r32 intensity;            // of the whole face
+};
+
+struct HalfSpaceTriangle {
+  // Counter-clockwise vertices and the bounding box of the pixels they
+  // cover, clipped to the screen
+  v3i p[3];
+  Rect2i bounds;
+
+  // x and y of the vertices are in 1 / (1 << subpixel_bits) pixels, and
+  // pixels are sampled sample_offset in from their corner
+  int subpixel_bits;
+  int sample_offset;
+
+  // Added to the edge functions, -1 for the edges that don't own the
+  // pixels exactly on them
+  int edge_bias[3];
+
+  u32 state;  // RasterState
+  u32 id;     // for RasterPass_TriangleId
+
+  // Conservative depth range, with room for rounding
+  int z_min;
+  int z_max;
+
+  // Edge function steps per pixel in x and in y. Edge i is the one
+  // opposite to vertex i, so its value is the (scaled) weight of vertex i
+  int step_x[3];
+  int step_y[3];
+
+  // Attribute planes as value at vertex 0 and steps per pixel. The ones
+  // that are rounded have the 0.5 added in. With perspective, u and v are
+  // divided by w and q is 1/w
+  r32 subpixel_size;  // in pixels
+  r32 z0, dz_dx, dz_dy;
+  r32 u0, du_dx, du_dy;
+  r32 v0, dv_dx, dv_dy;
+  r32 q0, dq_dx, dq_dy;
+  r32 i0, di_dx, di_dy;
+
+  // Steps from the first pixel of a block row to the others
+  r32 lane_z[kBlockSize];
+  r32 lane_u[kBlockSize];
+  r32 lane_v[kBlockSize];
+  r32 lane_q[kBlockSize];
+  r32 lane_i[kBlockSize];
+
+  r32 intensity;
+  u32 color;
+  r32 alpha;
+  r32 inv_alpha;
+
+  // Texture coordinates are in level 0 texels, shifted down to the level.
+  // Interpolated ones are clamped to the last texel, the divide of the
+  // perspective path can round them just past the edge
+  TextureLevel *texture_level;
+  int texture_shift;
+  r32 max_u;
+  r32 max_v;
+};
+
+// Twice the signed area of a, b and x, y
+inline i64 EdgeFunction64(v3i *a, v3i *b, int x, int y) {
+  i64 result = (i64)(b->x - a->x) * (y - a->y) -
+               (i64)(b->y - a->y) * (x - a->x);
+  return result;
+}
+
+// Edge values saturate at this. With the vertices in the guard band the
+// steps stay below 2^25, so across a block a saturated value changes by
+// less than 2^29 and keeps its sign, and nothing overflows 32 bits
+const i64 kEdgeLimit = 1 << 29;
+
+// Far from a triangle with a vertex off the screen the products don't
+// fit 32 bits. Only the sign matters there
+inline int EdgeFunction(v3i *a, v3i *b, int x, int y) {
+  i64 edge = EdgeFunction64(a, b, x, y);
+  int result = (int)Min(Max(edge, -kEdgeLimit), kEdgeLimit);
+  return result;
+}
+
+// For counter-clockwise triangles with y up, the inside is to the left of
+// every edge. Top edges go right to left, left edges go down
+inline bool32 IsTopLeftEdge(v3i *a, v3i *b) {
+  int dx = b->x - a->x;
+  int dy = b->y - a->y;
+  bool32 result = dy < 0 || (dy == 0 && dx < 0);
+  return result;
+}
+
+// Attributes at the first pixel of a block row
+struct HalfSpaceRow {
+  r32 z, u, v, q, i;
+};
+
+// Pixels of a triangle, kept by the kernels in BUILD_INTERNAL builds only
+struct RasterCounts {
+  int tested;  // inside the triangle, reaching the depth test
+  int passed;  // drawn
+};
+
+// The rasterizer and its pixel kernels are templates over the RasterState
+// flags, which are compile time constants inside them. Every state gets its
+// own inner loop without the branches of the others, and the triangle
+// picks its rasterizer from a table once.
+
+// Pixel lane of the block row. depth_passes means the depth test is known
+// to pass, so it's skipped. Return whether the pixel was drawn
+template <u32 kState>
+inline bool32 ShadeHalfSpacePixel(HalfSpaceTriangle *tri, HalfSpaceRow *row,
+                                  int lane, bool32 depth_passes, int *depth,
+                                  u32 *pixel) {
+  int z = (int)(row->z + tri->lane_z[lane]);
+  if ((kState & RasterState_DepthTest) && !depth_passes && *depth >= z) {
+    return false;
+  }
+  if (kState & RasterState_DepthWrite) *depth = z;
+  if (kState & RasterState_DepthOnly) return true;
+  if (kState & RasterState_TriangleId) {
+    *pixel = tri->id;
+    return true;
+  }
+
+  u32 color = tri->color;
+  if (kState & RasterState_Textured) {
+    r32 u_r = row->u + tri->lane_u[lane];
+    r32 v_r = row->v + tri->lane_v[lane];
+    if (kState & RasterState_Perspective) {
+      r32 q = row->q + tri->lane_q[lane];
+      u_r = u_r / q + 0.5f;
+      v_r = v_r / q + 0.5f;
+    }
+    int u = (int)Min(Max(u_r, 0.0f), tri->max_u);
+    int v = (int)Min(Max(v_r, 0.0f), tri->max_v);
+    color = *GetTexel(tri->texture_level, u >> tri->texture_shift,
+                      v >> tri->texture_shift);
+  }
+
+  r32 intensity = tri->intensity;
+  if (kState & RasterState_Gouraud) {
+    intensity = Max(row->i + tri->lane_i[lane], 0.0f);
+  }
+  u32 r = (u32)(((color >> 16) & 0xFF) * intensity);
+  u32 g = (u32)(((color >> 8) & 0xFF) * intensity);
+  u32 b = (u32)((color & 0xFF) * intensity);
+
+  if (kState & RasterState_Blend) {
+    u32 old_color = *pixel;
+    r = (u32)(r * tri->alpha + ((old_color >> 16) & 0xFF) * tri->inv_alpha);
+    g = (u32)(g * tri->alpha + ((old_color >> 8) & 0xFF) * tri->inv_alpha);
+    b = (u32)(b * tri->alpha + (old_color & 0xFF) * tri->inv_alpha);
+  }
+
+  *pixel = r << 16 | g << 8 | b;
+  return true;
+}
+
+// The span starts at the given lane of the block row
+template <u32 kState>
+internal bool32 ShadeHalfSpaceSpanScalar(HalfSpaceTriangle *tri, int e0,
+                                         int e1, int e2, HalfSpaceRow *row,
+                                         int lane, int count, bool32 full,
+                                         bool32 depth_passes, int *depth,
+                                         u32 *pixel, RasterCounts *counts) {
+  bool32 drawn = false;
+  if (full) {
+    DEBUG_ADD(counts->tested, count);
+    for (int x = 0; x < count; ++x) {
+      bool32 pixel_drawn = ShadeHalfSpacePixel<kState>(
+          tri, row, lane + x, depth_passes, depth, pixel);
+      DEBUG_ADD(counts->passed, pixel_drawn);
+      drawn |= pixel_drawn;
+      depth++;
+      pixel++;
+    }
+  } else {
+    for (int x = 0; x < count; ++x) {
+      // All three are non-negative iff the sign bit of the OR is 0
+      if ((e0 | e1 | e2) >= 0) {
+        bool32 pixel_drawn = ShadeHalfSpacePixel<kState>(
+            tri, row, lane + x, depth_passes, depth, pixel);
+        DEBUG_ADD(counts->tested, 1);
+        DEBUG_ADD(counts->passed, pixel_drawn);
+        drawn |= pixel_drawn;
+      }
+      e0 += tri->step_x[0];
+      e1 += tri->step_x[1];
+      e2 += tri->step_x[2];
+      depth++;
+      pixel++;
+    }
+  }
+  return drawn;
+}
+
+#if RASTER_SIMD_WIDTH == 8
+
+template <u32 kState>
+internal bool32 ShadeHalfSpaceSpan(HalfSpaceTriangle *tri, int e0, int e1,
+                                   int e2, HalfSpaceRow *row, int lane,
+                                   int count, bool32 full,
+                                   bool32 depth_passes, int *depth,
+                                   u32 *pixel, RasterCounts *counts) {
+  bool32 drawn = false;
+  int x = 0;
+
+  if (count >= 8) {
+    __m256i lanes = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    __m256i e0_8 = _mm256_add_epi32(
+        _mm256_set1_epi32(e0),
+        _mm256_mullo_epi32(lanes, _mm256_set1_epi32(tri->step_x[0])));
+    __m256i e1_8 = _mm256_add_epi32(
+        _mm256_set1_epi32(e1),
+        _mm256_mullo_epi32(lanes, _mm256_set1_epi32(tri->step_x[1])));
+    __m256i e2_8 = _mm256_add_epi32(
+        _mm256_set1_epi32(e2),
+        _mm256_mullo_epi32(lanes, _mm256_set1_epi32(tri->step_x[2])));
+    __m256i step0 = _mm256_set1_epi32(tri->step_x[0] * 8);
+    __m256i step1 = _mm256_set1_epi32(tri->step_x[1] * 8);
+    __m256i step2 = _mm256_set1_epi32(tri->step_x[2] * 8);
+
+    __m256 half = _mm256_set1_ps(0.5f);
+    __m256 row_z = _mm256_set1_ps(row->z);
+    __m256 row_u = _mm256_set1_ps(row->u);
+    __m256 row_v = _mm256_set1_ps(row->v);
+    __m256 row_q = _mm256_set1_ps(row->q);
+    __m256 row_i = _mm256_set1_ps(row->i);
+    __m256 intensity = _mm256_set1_ps(tri->intensity);
+    __m256 alpha = _mm256_set1_ps(tri->alpha);
+    __m256 inv_alpha = _mm256_set1_ps(tri->inv_alpha);
+    __m256i solid_color = _mm256_set1_epi32((int)tri->color);
+    __m128i texture_shift = _mm_cvtsi32_si128(tri->texture_shift);
+    __m256 max_u = _mm256_set1_ps(tri->max_u);
+    __m256 max_v = _mm256_set1_ps(tri->max_v);
+    __m256i tiles_x = _mm256_set1_epi32(tri->texture_level->tiles_x);
+    __m256i tile_mask = _mm256_set1_epi32(kTextureTileMask);
+    __m256i mask_ff = _mm256_set1_epi32(0xFF);
+    const int *texels = (const int *)tri->texture_level->texels;
+    bool32 test_depth = (kState & RasterState_DepthTest) && !depth_passes;
+
+    for (; x + 8 <= count; x += 8) {
+      __m256i mask = _mm256_set1_epi32(-1);
+      if (!full) {
+        __m256i e_or = _mm256_or_si256(_mm256_or_si256(e0_8, e1_8), e2_8);
+        mask = _mm256_cmpgt_epi32(e_or, _mm256_set1_epi32(-1));
+      }
+      DEBUG_ADD(counts->tested, CountSetBits(_mm256_movemask_ps(
+                                    _mm256_castsi256_ps(mask))));
+
+      e0_8 = _mm256_add_epi32(e0_8, step0);
+      e1_8 = _mm256_add_epi32(e1_8, step1);
+      e2_8 = _mm256_add_epi32(e2_8, step2);
+
+      int first = lane + x;
+      __m256i z = _mm256_cvttps_epi32(
+          _mm256_add_ps(row_z, _mm256_loadu_ps(tri->lane_z + first)));
+
+      __m256i old_depth = _mm256_setzero_si256();
+      if (test_depth) {
+        old_depth = _mm256_loadu_si256((__m256i *)(depth + x));
+        mask = _mm256_and_si256(mask, _mm256_cmpgt_epi32(z, old_depth));
+      }
+      if (_mm256_testz_si256(mask, mask)) continue;
+      drawn = true;
+      DEBUG_ADD(counts->passed, CountSetBits(_mm256_movemask_ps(
+                                    _mm256_castsi256_ps(mask))));
+
+      if (kState & RasterState_DepthWrite) {
+        if (test_depth) {
+          _mm256_storeu_si256((__m256i *)(depth + x),
+                              _mm256_blendv_epi8(old_depth, z, mask));
+        } else if (full) {
+          _mm256_storeu_si256((__m256i *)(depth + x), z);
+        } else {
+          _mm256_maskstore_epi32(depth + x, mask, z);
+        }
+      }
+      if (kState & RasterState_DepthOnly) continue;
+      if (kState & RasterState_TriangleId) {
+        __m256i old_id = _mm256_loadu_si256((__m256i *)(pixel + x));
+        _mm256_storeu_si256(
+            (__m256i *)(pixel + x),
+            _mm256_blendv_epi8(old_id, _mm256_set1_epi32((int)tri->id),
+                               mask));
+        continue;
+      }
+
+      __m256i texel = solid_color;
+      if (kState & RasterState_Textured) {
+        __m256 u_r =
+            _mm256_add_ps(row_u, _mm256_loadu_ps(tri->lane_u + first));
+        __m256 v_r =
+            _mm256_add_ps(row_v, _mm256_loadu_ps(tri->lane_v + first));
+        if (kState & RasterState_Perspective) {
+          __m256 q =
+              _mm256_add_ps(row_q, _mm256_loadu_ps(tri->lane_q + first));
+          u_r = _mm256_add_ps(_mm256_div_ps(u_r, q), half);
+          v_r = _mm256_add_ps(_mm256_div_ps(v_r, q), half);
+        }
+        // Clamped the same way as the scalar path, NaN included
+        u_r = _mm256_min_ps(_mm256_max_ps(u_r, _mm256_setzero_ps()), max_u);
+        v_r = _mm256_min_ps(_mm256_max_ps(v_r, _mm256_setzero_ps()), max_v);
+        __m256i u = _mm256_cvttps_epi32(u_r);
+        __m256i v = _mm256_cvttps_epi32(v_r);
+        u = _mm256_srl_epi32(u, texture_shift);
+        v = _mm256_srl_epi32(v, texture_shift);
+
+        // Same as GetTexel
+        __m256i tile = _mm256_add_epi32(
+            _mm256_mullo_epi32(_mm256_srli_epi32(v, kTextureTileShift),
+                               tiles_x),
+            _mm256_srli_epi32(u, kTextureTileShift));
+        __m256i index = _mm256_or_si256(
+            _mm256_slli_epi32(tile, 2 * kTextureTileShift),
+            _mm256_or_si256(
+                _mm256_slli_epi32(_mm256_and_si256(v, tile_mask),
+                                  kTextureTileShift),
+                _mm256_and_si256(u, tile_mask)));
+
+        // Masked off lanes may point outside of the texture, skip them
+        texel = _mm256_mask_i32gather_epi32(_mm256_setzero_si256(), texels,
+                                            index, mask, 4);
+      }
+
+      __m256 pixel_intensity = intensity;
+      if (kState & RasterState_Gouraud) {
+        pixel_intensity = _mm256_max_ps(
+            _mm256_add_ps(row_i, _mm256_loadu_ps(tri->lane_i + first)),
+            _mm256_setzero_ps());
+      }
+
+      __m256i r = _mm256_and_si256(_mm256_srli_epi32(texel, 16), mask_ff);
+      __m256i g = _mm256_and_si256(_mm256_srli_epi32(texel, 8), mask_ff);
+      __m256i b = _mm256_and_si256(texel, mask_ff);
+      r = _mm256_cvttps_epi32(
+          _mm256_mul_ps(_mm256_cvtepi32_ps(r), pixel_intensity));
+      g = _mm256_cvttps_epi32(
+          _mm256_mul_ps(_mm256_cvtepi32_ps(g), pixel_intensity));
+      b = _mm256_cvttps_epi32(
+          _mm256_mul_ps(_mm256_cvtepi32_ps(b), pixel_intensity));
+
+      __m256i old_color = _mm256_loadu_si256((__m256i *)(pixel + x));
+      if (kState & RasterState_Blend) {
+        __m256i old_r =
+            _mm256_and_si256(_mm256_srli_epi32(old_color, 16), mask_ff);
+        __m256i old_g =
+            _mm256_and_si256(_mm256_srli_epi32(old_color, 8), mask_ff);
+        __m256i old_b = _mm256_and_si256(old_color, mask_ff);
+        r = _mm256_cvttps_epi32(_mm256_add_ps(
+            _mm256_mul_ps(_mm256_cvtepi32_ps(r), alpha),
+            _mm256_mul_ps(_mm256_cvtepi32_ps(old_r), inv_alpha)));
+        g = _mm256_cvttps_epi32(_mm256_add_ps(
+            _mm256_mul_ps(_mm256_cvtepi32_ps(g), alpha),
+            _mm256_mul_ps(_mm256_cvtepi32_ps(old_g), inv_alpha)));
+        b = _mm256_cvttps_epi32(_mm256_add_ps(
+            _mm256_mul_ps(_mm256_cvtepi32_ps(b), alpha),
+            _mm256_mul_ps(_mm256_cvtepi32_ps(old_b), inv_alpha)));
+      }
+
+      __m256i color = _mm256_or_si256(
+          _mm256_or_si256(_mm256_slli_epi32(r, 16), _mm256_slli_epi32(g, 8)),
+          b);
+      _mm256_storeu_si256((__m256i *)(pixel + x),
+                          _mm256_blendv_epi8(old_color, color, mask));
+    }
+  }
+
+  if (x < count) {
+    e0 += tri->step_x[0] * x;
+    e1 += tri->step_x[1] * x;
+    e2 += tri->step_x[2] * x;
+    drawn |= ShadeHalfSpaceSpanScalar<kState>(
+        tri, e0, e1, e2, row, lane + x, count - x, full, depth_passes,
+        depth + x, pixel + x, counts);
+  }
+  return drawn;
+}
+
+#elif RASTER_SIMD_WIDTH == 4
+
+inline __m128i Select128(__m128i mask, __m128i a, __m128i b) {
+  // mask ? b : a
+  __m128i result =
+      _mm_or_si128(_mm_and_si128(mask, b), _mm_andnot_si128(mask, a));
+  return result;
+}
+
+template <u32 kState>
+internal bool32 ShadeHalfSpaceSpan(HalfSpaceTriangle *tri, int e0, int e1,
+                                   int e2, HalfSpaceRow *row, int lane,
+                                   int count, bool32 full,
+                                   bool32 depth_passes, int *depth,
+                                   u32 *pixel, RasterCounts *counts) {
+  bool32 drawn = false;
+  int x = 0;
+
+  if (count >= 4) {
+    int s0 = tri->step_x[0];
+    int s1 = tri->step_x[1];
+    int s2 = tri->step_x[2];
+    __m128i e0_4 = _mm_setr_epi32(e0, e0 + s0, e0 + 2 * s0, e0 + 3 * s0);
+    __m128i e1_4 = _mm_setr_epi32(e1, e1 + s1, e1 + 2 * s1, e1 + 3 * s1);
+    __m128i e2_4 = _mm_setr_epi32(e2, e2 + s2, e2 + 2 * s2, e2 + 3 * s2);
+    __m128i step0 = _mm_set1_epi32(s0 * 4);
+    __m128i step1 = _mm_set1_epi32(s1 * 4);
+    __m128i step2 = _mm_set1_epi32(s2 * 4);
+
+    __m128 half = _mm_set1_ps(0.5f);
+    __m128 row_z = _mm_set1_ps(row->z);
+    __m128 row_u = _mm_set1_ps(row->u);
+    __m128 row_v = _mm_set1_ps(row->v);
+    __m128 row_q = _mm_set1_ps(row->q);
+    __m128 row_i = _mm_set1_ps(row->i);
+    __m128 intensity = _mm_set1_ps(tri->intensity);
+    __m128 alpha = _mm_set1_ps(tri->alpha);
+    __m128 inv_alpha = _mm_set1_ps(tri->inv_alpha);
+    __m128i solid_color = _mm_set1_epi32((int)tri->color);
+    __m128i mask_ff = _mm_set1_epi32(0xFF);
+    TextureLevel *texture_level = tri->texture_level;
+    int texture_shift = tri->texture_shift;
+    __m128 max_u = _mm_set1_ps(tri->max_u);
+    __m128 max_v = _mm_set1_ps(tri->max_v);
+    bool32 test_depth = (kState & RasterState_DepthTest) && !depth_passes;
+
+    for (; x + 4 <= count; x += 4) {
+      __m128i mask = _mm_set1_epi32(-1);
+      if (!full) {
+        __m128i e_or = _mm_or_si128(_mm_or_si128(e0_4, e1_4), e2_4);
+        mask = _mm_cmpgt_epi32(e_or, _mm_set1_epi32(-1));
+      }
+      DEBUG_ADD(counts->tested,
+                CountSetBits(_mm_movemask_ps(_mm_castsi128_ps(mask))));
+
+      e0_4 = _mm_add_epi32(e0_4, step0);
+      e1_4 = _mm_add_epi32(e1_4, step1);
+      e2_4 = _mm_add_epi32(e2_4, step2);
+
+      int first = lane + x;
+      __m128i z = _mm_cvttps_epi32(
+          _mm_add_ps(row_z, _mm_loadu_ps(tri->lane_z + first)));
+
+      __m128i old_depth = _mm_loadu_si128((__m128i *)(depth + x));
+      if (test_depth) {
+        mask = _mm_and_si128(mask, _mm_cmpgt_epi32(z, old_depth));
+      }
+      int lane_mask = _mm_movemask_ps(_mm_castsi128_ps(mask));
+      if (!lane_mask) continue;
+      drawn = true;
+      DEBUG_ADD(counts->passed, CountSetBits(lane_mask));
+
+      if (kState & RasterState_DepthWrite) {
+        _mm_storeu_si128((__m128i *)(depth + x),
+                         Select128(mask, old_depth, z));
+      }
+      if (kState & RasterState_DepthOnly) continue;
+      if (kState & RasterState_TriangleId) {
+        __m128i old_id = _mm_loadu_si128((__m128i *)(pixel + x));
+        _mm_storeu_si128(
+            (__m128i *)(pixel + x),
+            Select128(mask, old_id, _mm_set1_epi32((int)tri->id)));
+        continue;
+      }
+
+      __m128i texel = solid_color;
+      if (kState & RasterState_Textured) {
+        __m128 u_r = _mm_add_ps(row_u, _mm_loadu_ps(tri->lane_u + first));
+        __m128 v_r = _mm_add_ps(row_v, _mm_loadu_ps(tri->lane_v + first));
+        if (kState & RasterState_Perspective) {
+          __m128 q = _mm_add_ps(row_q, _mm_loadu_ps(tri->lane_q + first));
+          u_r = _mm_add_ps(_mm_div_ps(u_r, q), half);
+          v_r = _mm_add_ps(_mm_div_ps(v_r, q), half);
+        }
+        // Clamped the same way as the scalar path, NaN included
+        u_r = _mm_min_ps(_mm_max_ps(u_r, _mm_setzero_ps()), max_u);
+        v_r = _mm_min_ps(_mm_max_ps(v_r, _mm_setzero_ps()), max_v);
+        __m128i u = _mm_cvttps_epi32(u_r);
+        __m128i v = _mm_cvttps_epi32(v_r);
+
+        // No gather in SSE2, fetch only the lanes that are drawn
+        ALIGN16 i32 u_lanes[4];
+        ALIGN16 i32 v_lanes[4];
+        ALIGN16 u32 texel_lanes[4] = {};
+        _mm_store_si128((__m128i *)u_lanes, u);
+        _mm_store_si128((__m128i *)v_lanes, v);
+        for (int i = 0; i < 4; ++i) {
+          if (lane_mask & (1 << i)) {
+            texel_lanes[i] = *GetTexel(texture_level,
+                                       u_lanes[i] >> texture_shift,
+                                       v_lanes[i] >> texture_shift);
+          }
+        }
+        texel = _mm_load_si128((__m128i *)texel_lanes);
+      }
+
+      __m128 pixel_intensity = intensity;
+      if (kState & RasterState_Gouraud) {
+        pixel_intensity =
+            _mm_max_ps(_mm_add_ps(row_i, _mm_loadu_ps(tri->lane_i + first)),
+                       _mm_setzero_ps());
+      }
+
+      __m128i r = _mm_and_si128(_mm_srli_epi32(texel, 16), mask_ff);
+      __m128i g = _mm_and_si128(_mm_srli_epi32(texel, 8), mask_ff);
+      __m128i b = _mm_and_si128(texel, mask_ff);
+      r = _mm_cvttps_epi32(_mm_mul_ps(_mm_cvtepi32_ps(r), pixel_intensity));
+      g = _mm_cvttps_epi32(_mm_mul_ps(_mm_cvtepi32_ps(g), pixel_intensity));
+      b = _mm_cvttps_epi32(_mm_mul_ps(_mm_cvtepi32_ps(b), pixel_intensity));
+
+      __m128i old_color = _mm_loadu_si128((__m128i *)(pixel + x));
+      if (kState & RasterState_Blend) {
+        __m128i old_r = _mm_and_si128(_mm_srli_epi32(old_color, 16), mask_ff);
+        __m128i old_g = _mm_and_si128(_mm_srli_epi32(old_color, 8), mask_ff);
+        __m128i old_b = _mm_and_si128(old_color, mask_ff);
+        r = _mm_cvttps_epi32(
+            _mm_add_ps(_mm_mul_ps(_mm_cvtepi32_ps(r), alpha),
+                       _mm_mul_ps(_mm_cvtepi32_ps(old_r), inv_alpha)));
+        g = _mm_cvttps_epi32(
+            _mm_add_ps(_mm_mul_ps(_mm_cvtepi32_ps(g), alpha),
+                       _mm_mul_ps(_mm_cvtepi32_ps(old_g), inv_alpha)));
+        b = _mm_cvttps_epi32(
+            _mm_add_ps(_mm_mul_ps(_mm_cvtepi32_ps(b), alpha),
+                       _mm_mul_ps(_mm_cvtepi32_ps(old_b), inv_alpha)));
+      }
+
+      __m128i color = _mm_or_si128(
+          _mm_or_si128(_mm_slli_epi32(r, 16), _mm_slli_epi32(g, 8)), b);
+      _mm_storeu_si128((__m128i *)(pixel + x),
+                       Select128(mask, old_color, color));
+    }
+  }
+
+  if (x < count) {
+    e0 += tri->step_x[0] * x;
+    e1 += tri->step_x[1] * x;
+    e2 += tri->step_x[2] * x;
+    drawn |= ShadeHalfSpaceSpanScalar<kState>(
+        tri, e0, e1, e2, row, lane + x, count - x, full, depth_passes,
+        depth + x, pixel + x, counts);
+  }
+  return drawn;
+}
+
+#else
+
+template <u32 kState>
+internal bool32 ShadeHalfSpaceSpan(HalfSpaceTriangle *tri, int e0, int e1,
+                                   int e2, HalfSpaceRow *row, int lane,
+                                   int count, bool32 full,
+                                   bool32 depth_passes, int *depth,
+                                   u32 *pixel, RasterCounts *counts) {
+  return ShadeHalfSpaceSpanScalar<kState>(tri, e0, e1, e2, row, lane, count,
+                                          full, depth_passes, depth, pixel,
+                                          counts);
+}
+
+#endif
+
+// a0, a1 and a2 are the attribute at the three vertices
+internal void SetupAttributePlane(HalfSpaceTriangle *tri, r32 a0, r32 a1,
+                                  r32 a2, r32 inv_area, r32 *at_vertex,
+                                  r32 *d_dx, r32 *d_dy, r32 *lanes) {
+  r32 da1 = a1 - a0;
+  r32 da2 = a2 - a0;
+  *at_vertex = a0;
+  *d_dx = (tri->step_x[1] * da1 + tri->step_x[2] * da2) * inv_area;
+  *d_dy = (tri->step_y[1] * da1 + tri->step_y[2] * da2) * inv_area;
+  for (int i = 0; i < kBlockSize; ++i) {
+    lanes[i] = i * *d_dx;
+  }
+}
+
+// Returns false if there's nothing to draw
+internal bool32 SetupHalfSpaceTriangle(HalfSpaceTriangle *tri,
+                                       AssembledFace *face,
+                                       PipelineState *state, int width,
+                                       int height) {
+  v3i *p0 = &face->p[0];
+  v3i *p1 = &face->p[1];
+  v3i *p2 = &face->p[2];
+
+  v2i *uv0 = &face->uv[0];
+  v2i *uv1 = &face->uv[1];
+  v2i *uv2 = &face->uv[2];
+
+  // Vertex 1 and 2 may swap below, these follow them
+  bool32 perspective = state->flags & RasterState_Perspective;
+  bool32 gouraud = state->flags & RasterState_Gouraud;
+  r32 q[3] = {1.0f, 1.0f, 1.0f};
+  r32 vertex_intensity[3] = {};
+  for (int i = 0; i < 3; ++i) {
+    if (perspective) q[i] = face->inv_w[i];
+    if (gouraud) vertex_intensity[i] = face->vertex_intensity[i];
+  }
+
+  // Make the winding counter-clockwise so that inside is non-negative. The
+  // area of a large triangle doesn't fit 32 bits in fixed point
+  i64 area = EdgeFunction64(p1, p2, p0->x, p0->y);
+  if (area == 0) return false;
+  if (area < 0) {
+    swap_pointers(&p1, &p2);
+    swap_pointers(&uv1, &uv2);
+    r32 swap = q[1];
+    q[1] = q[2];
+    q[2] = swap;
+    swap = vertex_intensity[1];
+    vertex_intensity[1] = vertex_intensity[2];
+    vertex_intensity[2] = swap;
+    area = -area;
+  }
+
+  int subpixel_bits = state->subpixel_bits;
+
+  // Pixels whose sample points are inside the vertex bounds
+  int sample_offset = subpixel_bits ? 1 << (subpixel_bits - 1) : 0;
+  int round_up = (1 << subpixel_bits) - 1;
+  Rect2i screen = {0, 0, width - 1, height - 1};
+  Rect2i bounds;
+  bounds.min_x = (Min(p0->x, Min(p1->x, p2->x)) - sample_offset + round_up) >>
+                 subpixel_bits;
+  bounds.min_y = (Min(p0->y, Min(p1->y, p2->y)) - sample_offset + round_up) >>
+                 subpixel_bits;
+  bounds.max_x = (Max(p0->x, Max(p1->x, p2->x)) - sample_offset) >>
+                 subpixel_bits;
+  bounds.max_y = (Max(p0->y, Max(p1->y, p2->y)) - sample_offset) >>
+                 subpixel_bits;
+  tri->bounds = Intersect(bounds, screen);
+  if (IsEmpty(tri->bounds)) return false;
+
+  tri->subpixel_bits = subpixel_bits;
+  tri->sample_offset = sample_offset;
+  if (subpixel_bits) {
+    tri->edge_bias[0] = IsTopLeftEdge(p1, p2) ? 0 : -1;
+    tri->edge_bias[1] = IsTopLeftEdge(p2, p0) ? 0 : -1;
+    tri->edge_bias[2] = IsTopLeftEdge(p0, p1) ? 0 : -1;
+  } else {
+    tri->edge_bias[0] = tri->edge_bias[1] = tri->edge_bias[2] = 0;
+  }
+
+  tri->p[0] = *p0;
+  tri->p[1] = *p1;
+  tri->p[2] = *p2;
+
+  tri->z_min = Min(p0->z, Min(p1->z, p2->z)) - 1;
+  tri->z_max = Max(p0->z, Max(p1->z, p2->z)) + 1;
+
+  // A step of a whole pixel, multiplied as the differences can be negative
+  int pixel_size = 1 << subpixel_bits;
+  tri->step_x[0] = (p1->y - p2->y) * pixel_size;
+  tri->step_y[0] = (p2->x - p1->x) * pixel_size;
+  tri->step_x[1] = (p2->y - p0->y) * pixel_size;
+  tri->step_y[1] = (p0->x - p2->x) * pixel_size;
+  tri->step_x[2] = (p0->y - p1->y) * pixel_size;
+  tri->step_y[2] = (p1->x - p0->x) * pixel_size;
+
+  r32 inv_area = 1.0f / (r32)area;
+  tri->subpixel_size = 1.0f / (1 << subpixel_bits);
+  SetupAttributePlane(tri, (r32)p0->z, (r32)p1->z, (r32)p2->z, inv_area,
+                      &tri->z0, &tri->dz_dx, &tri->dz_dy, tri->lane_z);
+  tri->z0 += 0.5f;
+
+  if (state->flags & RasterState_Textured) {
+    SetupAttributePlane(tri, uv0->x * q[0], uv1->x * q[1], uv2->x * q[2],
+                        inv_area, &tri->u0, &tri->du_dx, &tri->du_dy,
+                        tri->lane_u);
+    SetupAttributePlane(tri, uv0->y * q[0], uv1->y * q[1], uv2->y * q[2],
+                        inv_area, &tri->v0, &tri->dv_dx, &tri->dv_dy,
+                        tri->lane_v);
+    SetupAttributePlane(tri, q[0], q[1], q[2], inv_area, &tri->q0,
+                        &tri->dq_dx, &tri->dq_dy, tri->lane_q);
+    if (!perspective) {
+      // Rounded after the divide otherwise
+      tri->u0 += 0.5f;
+      tri->v0 += 0.5f;
+    }
+  }
+  if (gouraud) {
+    SetupAttributePlane(tri, vertex_intensity[0], vertex_intensity[1],
+                        vertex_intensity[2], inv_area, &tri->i0, &tri->di_dx,
+                        &tri->di_dy, tri->lane_i);
+  }
+
+  tri->state = state->flags;
+  tri->intensity = face->intensity;
+  tri->color = state->color;
+  tri->alpha = state->alpha;
+  tri->inv_alpha = 1.0f - state->alpha;
+
+  // Twice the triangle area in texels and in pixels
+  v2i duv1 = *uv1 - *uv0;
+  v2i duv2 = *uv2 - *uv0;
+  r32 texel_area = Abs((r32)duv1.x * duv2.y - (r32)duv1.y * duv2.x);
+  r32 pixel_area = (r32)area / (r32)(1 << (2 * subpixel_bits));
+  Texture *texture = state->texture;
+  tri->texture_shift = SelectTextureLevel(texture, texel_area, pixel_area);
+  tri->texture_level = &texture->levels[tri->texture_shift];
+  tri->max_u = (r32)Max(texture->width - 1, 0);
+  tri->max_v = (r32)Max(texture->height - 1, 0);
+
+  return true;
+}
+
+// Draws the part of the triangle inside clip_rect, which should be aligned
+// to kBlockSize unless it's on the edge of the screen. kState is tri->state
+template <u32 kState, bool32 kSimd>
+internal void RasterizeHalfSpaceTriangle(HalfSpaceTriangle *tri,
+                                         GameOffscreenBuffer *buffer,
+                                         Rect2i clip_rect) {
+  Rect2i rect = Intersect(tri->bounds, clip_rect);
+  if (IsEmpty(rect)) return;
+
+  const bool32 depth_test = kState & RasterState_DepthTest;
+  const bool32 depth_write = kState & RasterState_DepthWrite;
+
+  PrepareDepthTiles(buffer, rect);
+  if (depth_test && IsRectOccluded(buffer, rect, tri->z_max)) return;
+
+  v3i *p0 = &tri->p[0];
+  v3i *p1 = &tri->p[1];
+  v3i *p2 = &tri->p[2];
+
+  int width = buffer->width;
+  int height = buffer->height;
+  int pitch = width * buffer->bytes_per_pixel;
+  const int kBlockMask = ~(kBlockSize - 1);
+  bool32 depth_tiles_changed = false;
+  RasterCounts counts = {};
+
+  for (int block_y = rect.min_y & kBlockMask; block_y <= rect.max_y;
+       block_y += kBlockSize) {
+    for (int block_x = rect.min_x & kBlockMask; block_x <= rect.max_x;
+         block_x += kBlockSize) {
+      DepthBlock *depth_block = GetDepthBlock(buffer, block_x, block_y);
+      if (depth_test && tri->z_max <= depth_block->z_min) continue;
+
+      // Sample point of the first pixel of the block
+      int sample_x = (block_x << tri->subpixel_bits) + tri->sample_offset;
+      int sample_y = (block_y << tri->subpixel_bits) + tri->sample_offset;
+      int e[3];
+      e[0] = EdgeFunction(p1, p2, sample_x, sample_y) + tri->edge_bias[0];
+      e[1] = EdgeFunction(p2, p0, sample_x, sample_y) + tri->edge_bias[1];
+      e[2] = EdgeFunction(p0, p1, sample_x, sample_y) + tri->edge_bias[2];
+
+      // The edge functions are linear, so their extremes over the block
+      // are at the corners
+      bool32 outside = false;
+      bool32 full = true;
+      for (int i = 0; i < 3; ++i) {
+        int corner_x = tri->step_x[i] * (kBlockSize - 1);
+        int corner_y = tri->step_y[i] * (kBlockSize - 1);
+        int e_min = e[i] + Min(corner_x, 0) + Min(corner_y, 0);
+        int e_max = e[i] + Max(corner_x, 0) + Max(corner_y, 0);
+        if (e_max < 0) outside = true;
+        if (e_min < 0) full = false;
+      }
+      if (outside) continue;
+
+      // Blocks on the border of the rectangle are only partly drawn
+      int x0 = Max(block_x, rect.min_x);
+      int y0 = Max(block_y, rect.min_y);
+      int x1 = Min(block_x + kBlockSize - 1, rect.max_x);
+      int y1 = Min(block_y + kBlockSize - 1, rect.max_y);
+
+      int row_e[3];
+      for (int i = 0; i < 3; ++i) {
+        row_e[i] = e[i] + tri->step_x[i] * (x0 - block_x) +
+                   tri->step_y[i] * (y0 - block_y);
+      }
+
+      // Attributes at the start of the first row, the pixels from x0 on
+      // are offset by lane
+      r32 dx = (sample_x - p0->x) * tri->subpixel_size;
+      r32 dy = (sample_y - p0->y) * tri->subpixel_size + (y0 - block_y);
+      // Only the ones the state uses, the others may not be set up
+      HalfSpaceRow attributes = {};
+      attributes.z = tri->z0 + tri->dz_dx * dx + tri->dz_dy * dy;
+      if (kState & RasterState_Textured) {
+        attributes.u = tri->u0 + tri->du_dx * dx + tri->du_dy * dy;
+        attributes.v = tri->v0 + tri->dv_dx * dx + tri->dv_dy * dy;
+        attributes.q = tri->q0 + tri->dq_dx * dx + tri->dq_dy * dy;
+      }
+      if (kState & RasterState_Gouraud) {
+        attributes.i = tri->i0 + tri->di_dx * dx + tri->di_dy * dy;
+      }
+      int lane = x0 - block_x;
+
+      bool32 depth_passes =
+          !depth_test || tri->z_min > depth_block->z_max;
+      bool32 drawn = false;
+
+      for (int y = y0; y <= y1; ++y) {
+        // Depth-only buffers may not have color memory
+        u32 *pixel = 0;
+        if (!(kState & RasterState_DepthOnly)) {
+          u8 *row = (u8 *)buffer->memory + (height - 1) * pitch -
+                    pitch * y + x0 * buffer->bytes_per_pixel;
+          pixel = (u32 *)row;
+        }
+        int *depth = buffer->z_buffer + y * width + x0;
+
+        if (kSimd) {
+          drawn |= ShadeHalfSpaceSpan<kState>(
+              tri, row_e[0], row_e[1], row_e[2], &attributes, lane,
+              x1 - x0 + 1, full, depth_passes, depth, pixel, &counts);
+        } else {
+          drawn |= ShadeHalfSpaceSpanScalar<kState>(
+              tri, row_e[0], row_e[1], row_e[2], &attributes, lane,
+              x1 - x0 + 1, full, depth_passes, depth, pixel, &counts);
+        }
+
+        for (int i = 0; i < 3; ++i) {
+          row_e[i] += tri->step_y[i];
+        }
+        attributes.z += tri->dz_dy;
+        if (kState & RasterState_Textured) {
+          attributes.u += tri->du_dy;
+          attributes.v += tri->dv_dy;
+          attributes.q += tri->dq_dy;
+        }
+        if (kState & RasterState_Gouraud) attributes.i += tri->di_dy;
+      }
+
+      // Only depth writes change the depth bounds
+      if (drawn && depth_write) {
+        bool32 whole_block = full && x0 == block_x && y0 == block_y &&
+                             x1 == block_x + kBlockSize - 1 &&
+                             y1 == block_y + kBlockSize - 1;
+        if (whole_block && depth_passes) {
+          // Everything in the block has been replaced
+          depth_block->z_min = tri->z_min;
+          depth_block->z_max = tri->z_max;
+          depth_tiles_changed = true;
+        } else {
+          depth_block->z_max = Max(depth_block->z_max, tri->z_max);
+          if (RefreshDepthBlockMin(buffer, depth_block, block_x, block_y)) {
+            depth_tiles_changed = true;
+          }
+        }
+      }
+    }
+  }
+
+  if (depth_tiles_changed) RefreshDepthTiles(buffer, rect);
+
+  DEBUG_COUNT(PixelsTested, counts.tested);
+  DEBUG_COUNT(PixelsPassed, counts.passed);
+  if (!(kState & (RasterState_TriangleId | RasterState_DepthOnly))) {
+    DEBUG_COUNT(PixelsShaded, counts.passed);
+  }
+}
+
+typedef void RasterizeHalfSpaceTriangleFunction(HalfSpaceTriangle *tri,
+                                                GameOffscreenBuffer *buffer,
+                                                Rect2i clip_rect);
+
+struct HalfSpaceRasterizers {
+  RasterizeHalfSpaceTriangleFunction *scalar;
+  RasterizeHalfSpaceTriangleFunction *simd;
+};
+
+// One entry for every combination of the RasterState flags
+#define HALF_SPACE_RASTERIZERS(state)                \
+  {RasterizeHalfSpaceTriangle<(state), false>,      \
+   RasterizeHalfSpaceTriangle<(state), true>}
+#define HALF_SPACE_RASTERIZERS_4(state)                                \
+  HALF_SPACE_RASTERIZERS(state), HALF_SPACE_RASTERIZERS((state) + 1), \
+      HALF_SPACE_RASTERIZERS((state) + 2),                             \
+      HALF_SPACE_RASTERIZERS((state) + 3)
+#define HALF_SPACE_RASTERIZERS_16(state)          \
+  HALF_SPACE_RASTERIZERS_4(state),                \
+      HALF_SPACE_RASTERIZERS_4((state) + 4),      \
+      HALF_SPACE_RASTERIZERS_4((state) + 8),      \
+      HALF_SPACE_RASTERIZERS_4((state) + 12)
+
+global HalfSpaceRasterizers g_half_space_rasterizers[RasterState_Count] = {
+    HALF_SPACE_RASTERIZERS_16(0), HALF_SPACE_RASTERIZERS_16(16),
+    HALF_SPACE_RASTERIZERS_16(32), HALF_SPACE_RASTERIZERS_16(48)};
+
+global HalfSpaceRasterizers g_triangle_id_rasterizers =
+    HALF_SPACE_RASTERIZERS(RasterState_TriangleId | RasterState_DepthTest |
+                           RasterState_DepthWrite);
+global HalfSpaceRasterizers g_depth_only_rasterizers =
+    HALF_SPACE_RASTERIZERS(RasterState_DepthOnly | RasterState_DepthTest |
+                           RasterState_DepthWrite);
+
+#undef HALF_SPACE_RASTERIZERS_16
+#undef HALF_SPACE_RASTERIZERS_4
+#undef HALF_SPACE_RASTERIZERS
+
+// Picks the rasterizer of the pass, once per triangle
+internal void RasterizeHalfSpaceTriangle(HalfSpaceTriangle *tri,
+                                         GameOffscreenBuffer *buffer,
+                                         Rect2i clip_rect, RasterPass pass) {
+  TIMED_BLOCK(RasterizeTriangle);
+  HalfSpaceRasterizers *rasterizers = &g_half_space_rasterizers[tri->state];
+  if (pass == RasterPass_TriangleId) rasterizers = &g_triangle_id_rasterizers;
+  if (pass == RasterPass_DepthOnly) rasterizers = &g_depth_only_rasterizers;
+  if (g_render_settings.scalar_only) {
+    rasterizers->scalar(tri, buffer, clip_rect);
+  } else {
+    rasterizers->simd(tri, buffer, clip_rect);
+  }
+}
+
+internal void TriangleHalfSpace(AssembledFace *face, PipelineState *state,
+                                GameOffscreenBuffer *buffer) {
+  HalfSpaceTriangle tri;
+  if (SetupHalfSpaceTriangle(&tri, face, state, buffer->width,
+                             buffer->height)) {
+    DEBUG_COUNT(FacesRasterized, 1);
+    Rect2i screen = {0, 0, buffer->width - 1, buffer->height - 1};
+    RasterizeHalfSpaceTriangle(&tri, buffer, screen, RasterPass_Shade);
+  }
+}
+
+#endif  // RENDERER_RASTER_CPP
@@ -0,0 +1,95 @@
+#ifndef RENDERER_SHADOW_CPP
+#define RENDERER_SHADOW_CPP
+
+// Shadow map.
+// The depth of the model as seen from the light, drawn by the depth-only
+// rasterizer into a buffer without color. The light is directional, so
+// the view is orthographic along light_direction. The map follows the
+// z-buffer conventions, larger z is closer to the light. Only the faces
+// that face the light are drawn, the others are in its shadow anyway.
+
+// Scales the model's [-1, 1] cube down so that it fits the map from any
+// direction, 1 / sqrt(3)
+const r32 kShadowMapScale = 0.57735027f;
+
+// The map is a square depth buffer of size pixels
+internal bool32 AllocateShadowMap(GameOffscreenBuffer *map,
+                                  MemoryArena *arena, int size) {
+  bool32 result = AllocateDepthBuffer(map, arena, size, size);
+  if (result) ResizeBuffer(map, size, size);
+  return result;
+}
+
+// Depth at x, y, INT_MIN where nothing was drawn. The tiles that weren't
+// drawn into aren't cleared, see renderer_depth.cpp
+inline int GetShadowMapDepth(GameOffscreenBuffer *map, int x, int y) {
+  DepthTile *tile =
+      &map->depth_tiles[(y / kDepthTileSize) * GetDepthTilesX(map) +
+                        x / kDepthTileSize];
+  int result = INT_MIN;
+  if (tile->generation == map->generation) {
+    result = map->z_buffer[y * map->width + x];
+  }
+  return result;
+}
+
+// Rotates the model so that the light shines along -z, which is where the
+// default light comes from
+internal void GetLightAxes(v3 light_direction, v3 *right, v3 *up,
+                           v3 *forward) {
+  *forward = -Normalize(light_direction);
+  v3 world_up = {0, 1.0f, 0};
+  if (Abs(forward->y) > 0.99f) world_up = {1.0f, 0, 0};
+  *right = Normalize(CrossProduct(world_up, *forward));
+  *up = CrossProduct(*forward, *right);
+}
+
+// Returns false if the frame scratch doesn't fit in the arena, the map is
+// empty then
+internal bool32 RenderShadowMap(GameOffscreenBuffer *map, MemoryArena *arena,
+                                v3 light_direction) {
+  TIMED_BLOCK(RenderShadowMap);
+  ClearBuffer(map, 0);
+  if (!g_model.is_loaded || !map->z_buffer) return false;
+
+  TemporaryMemory temp = BeginTemporaryMemory(arena);
+  v3 *vertices = PushArray(arena, g_model.vert_count, v3);
+  ScreenVertices screen = {};
+  bool32 result = vertices != 0;
+  if (result) {
+    v3 right, up, forward;
+    GetLightAxes(light_direction, &right, &up, &forward);
+    for (int i = 0; i < g_model.vert_count; ++i) {
+      v3 vertex = g_model.vertices[i];
+      vertices[i].x = DotProduct(vertex, right) * kShadowMapScale;
+      vertices[i].y = DotProduct(vertex, up) * kShadowMapScale;
+      vertices[i].z = DotProduct(vertex, forward) * kShadowMapScale;
+    }
+    result = TransformVertices(&screen, arena, vertices, g_model.vert_count,
+                               map->height, 0, 0);
+  }
+
+  if (result) {
+    // The texture isn't sampled, it only has to be there
+    PipelineState state = {};
+    state.flags = RasterState_DepthTest | RasterState_DepthWrite;
+    state.texture = &g_model.diffuse;
+
+    Rect2i rect = {0, 0, map->width - 1, map->height - 1};
+    for (int i = 0; i < g_model.face_count; ++i) {
+      AssembledFace face;
+      if (!AssembleFace(i, light_direction, &screen, &state, &face)) continue;
+
+      HalfSpaceTriangle tri;
+      if (SetupHalfSpaceTriangle(&tri, &face, &state, map->width,
+                                 map->height)) {
+        RasterizeHalfSpaceTriangle(&tri, map, rect, RasterPass_DepthOnly);
+      }
+    }
+  }
+
+  EndTemporaryMemory(temp);
+  return result;
+}
+
+#endif  // RENDERER_SHADOW_CPP
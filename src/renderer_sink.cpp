@@ -0,0 +1,305 @@
+#ifndef RENDERER_SINK_CPP
+#define RENDERER_SINK_CPP
+
+// Frame sink.
+// Takes finished frames and writes them out on its own thread, so that
+// slow disks and pipes don't hold up drawing. A submitted frame is copied
+// into one of kFrameSinkSlotCount slots, converted to the pixel format of
+// the output on the way, and the writer thread encodes it and hands the
+// bytes to the platform. Submitting only waits when every slot is still
+// waiting to be written, which bounds the memory and keeps every frame.
+//
+// The raw formats are one frame after the other with nothing in between,
+// for piping into an encoder. PPM and QOI are whole image files, one per
+// frame, for sequences of files.
+
+#if defined(__SSSE3__) || defined(__AVX__)
+#include <tmmintrin.h>
+#define SINK_SIMD 1
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
+
+const int kFrameSinkSlotCount = 4;
+
+// Room for the PPM header in front of the pixels of a slot
+const int kFrameSinkHeaderSize = 32;
+
+// Writes the bytes of frame frame_index. Returns false if they weren't
+// all written
+#define FRAME_SINK_WRITE(name) \
+  bool32 name(void *bytes, u64 size, int frame_index, void *data)
+typedef FRAME_SINK_WRITE(FrameSinkWriteCallback);
+
+struct FrameSinkSlot {
+  u8 *memory;  // kFrameSinkHeaderSize, then the pixels
+  int width;
+  int height;
+  int frame_index;
+};
+
+struct FrameSink {
+  FrameSinkFormat format;
+  FrameSinkSlot slots[kFrameSinkSlotCount];
+  u8 *encoded;  // for QOI, written by the writer thread only
+
+  u32 frames_submitted;  // by the submitting thread
+  u32 frames_written;    // by the writer thread
+
+  PlatformSemaphore free_slots;
+  PlatformSemaphore full_slots;
+
+  FrameSinkWriteCallback *write;
+  void *write_data;
+
+  u64 bytes_written;
+  u64 wait_ns;  // the submitting thread spent waiting for a free slot
+  i32 volatile failed_count;
+};
+
+// Bytes B, G, R, X of every pixel to R, G, B
+internal void ConvertBGRAToRGB(u32 *pixels, int count, u8 *rgb) {
+  int i = 0;
+#if SINK_SIMD
+  // Packs the 12 bytes of 4 pixels into the low bytes of the register,
+  // and shifts 4 of those together into 3 full registers
+  __m128i shuffle =
+      _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+  for (; i + 16 <= count; i += 16) {
+    __m128i *in = (__m128i *)(pixels + i);
+    __m128i a = _mm_shuffle_epi8(_mm_loadu_si128(in + 0), shuffle);
+    __m128i b = _mm_shuffle_epi8(_mm_loadu_si128(in + 1), shuffle);
+    __m128i c = _mm_shuffle_epi8(_mm_loadu_si128(in + 2), shuffle);
+    __m128i d = _mm_shuffle_epi8(_mm_loadu_si128(in + 3), shuffle);
+
+    __m128i out0 = _mm_or_si128(a, _mm_slli_si128(b, 12));
+    __m128i out1 = _mm_or_si128(_mm_srli_si128(b, 4), _mm_slli_si128(c, 8));
+    __m128i out2 = _mm_or_si128(_mm_srli_si128(c, 8), _mm_slli_si128(d, 4));
+    __m128i *out = (__m128i *)(rgb + 3 * i);
+    _mm_storeu_si128(out + 0, out0);
+    _mm_storeu_si128(out + 1, out1);
+    _mm_storeu_si128(out + 2, out2);
+  }
+#endif
+  for (; i < count; ++i) {
+    u32 pixel = pixels[i];
+    rgb[3 * i + 0] = (u8)(pixel >> 16);
+    rgb[3 * i + 1] = (u8)(pixel >> 8);
+    rgb[3 * i + 2] = (u8)pixel;
+  }
+}
+
+// Same pixels with the unused byte set to an opaque alpha
+internal void ConvertToOpaqueBGRA(u32 *pixels, int count, u32 *bgra) {
+  int i = 0;
+#if defined(__SSE2__) || defined(_M_X64)
+  __m128i alpha = _mm_set1_epi32((int)0xFF000000);
+  for (; i + 4 <= count; i += 4) {
+    __m128i pixel = _mm_loadu_si128((__m128i *)(pixels + i));
+    _mm_storeu_si128((__m128i *)(bgra + i), _mm_or_si128(pixel, alpha));
+  }
+#endif
+  for (; i < count; ++i) bgra[i] = pixels[i] | 0xFF000000;
+}
+
+inline int GetFrameSinkPixelSize(FrameSinkFormat format) {
+  int result = (format == FrameSink_BGRA || format == FrameSink_QOI) ? 4 : 3;
+  return result;
+}
+
+// QOI, see qoiformat.org. The pixels are opaque 0xAARRGGBB
+inline u8 *PutBigEndianU32(u8 *out, u32 value) {
+  *out++ = (u8)(value >> 24);
+  *out++ = (u8)(value >> 16);
+  *out++ = (u8)(value >> 8);
+  *out++ = (u8)value;
+  return out;
+}
+
+inline u64 GetMaxQOISize(int width, int height) {
+  u64 result = (u64)width * height * 4 + 14 + 8;
+  return result;
+}
+
+// Returns the size of the image in out, which has to hold
+// GetMaxQOISize bytes
+internal u64 EncodeQOI(u32 *pixels, int width, int height, u8 *out) {
+  u8 *start = out;
+  *out++ = 'q';
+  *out++ = 'o';
+  *out++ = 'i';
+  *out++ = 'f';
+  out = PutBigEndianU32(out, width);
+  out = PutBigEndianU32(out, height);
+  *out++ = 3;  // channels, alpha is always 255
+  *out++ = 0;  // sRGB
+
+  u32 index[64] = {};
+  u32 previous = 0xFF000000;
+  int run = 0;
+  int count = width * height;
+  for (int i = 0; i < count; ++i) {
+    u32 pixel = pixels[i];
+    if (pixel == previous) {
+      if (++run == 62) {
+        *out++ = (u8)(0xC0 | (run - 1));
+        run = 0;
+      }
+      continue;
+    }
+    if (run > 0) {
+      *out++ = (u8)(0xC0 | (run - 1));
+      run = 0;
+    }
+
+    int r = (pixel >> 16) & 0xFF;
+    int g = (pixel >> 8) & 0xFF;
+    int b = pixel & 0xFF;
+    int hash = (r * 3 + g * 5 + b * 7 + 255 * 11) % 64;
+    if (index[hash] == pixel) {
+      *out++ = (u8)hash;
+    } else {
+      index[hash] = pixel;
+
+      // Differences wrap around, as bytes
+      int dr = (i8)(r - ((previous >> 16) & 0xFF));
+      int dg = (i8)(g - ((previous >> 8) & 0xFF));
+      int db = (i8)(b - (previous & 0xFF));
+      int dr_dg = dr - dg;
+      int db_dg = db - dg;
+      if (dr >= -2 && dr <= 1 && dg >= -2 && dg <= 1 && db >= -2 &&
+          db <= 1) {
+        *out++ = (u8)(0x40 | (dr + 2) << 4 | (dg + 2) << 2 | (db + 2));
+      } else if (dg >= -32 && dg <= 31 && dr_dg >= -8 && dr_dg <= 7 &&
+                 db_dg >= -8 && db_dg <= 7) {
+        *out++ = (u8)(0x80 | (dg + 32));
+        *out++ = (u8)((dr_dg + 8) << 4 | (db_dg + 8));
+      } else {
+        *out++ = 0xFE;
+        *out++ = (u8)r;
+        *out++ = (u8)g;
+        *out++ = (u8)b;
+      }
+    }
+    previous = pixel;
+  }
+  if (run > 0) *out++ = (u8)(0xC0 | (run - 1));
+
+  for (int i = 0; i < 7; ++i) *out++ = 0;
+  *out++ = 1;
+
+  u64 result = out - start;
+  return result;
+}
+
+internal PLATFORM_THREAD_PROC(WriteSinkFrames) {
+  FrameSink *sink = (FrameSink *)data;
+  for (;;) {
+    PlatformWaitForSemaphore(&sink->full_slots);
+
+    TIMED_BLOCK(WriteSinkFrame);
+    FrameSinkSlot *slot =
+        &sink->slots[sink->frames_written % kFrameSinkSlotCount];
+    u8 *pixels = slot->memory + kFrameSinkHeaderSize;
+    u8 *bytes = pixels;
+    u64 size = (u64)slot->width * slot->height *
+               GetFrameSinkPixelSize(sink->format);
+    if (sink->format == FrameSink_PPM) {
+      // The header goes right in front of the pixels
+      char header[kFrameSinkHeaderSize];
+      int length = snprintf(header, sizeof(header), "P6\n%d %d\n255\n",
+                            slot->width, slot->height);
+      bytes = pixels - length;
+      memcpy(bytes, header, length);
+      size += length;
+    } else if (sink->format == FrameSink_QOI) {
+      bytes = sink->encoded;
+      size = EncodeQOI((u32 *)pixels, slot->width, slot->height, bytes);
+    }
+
+    if (sink->write(bytes, size, slot->frame_index, sink->write_data)) {
+      sink->bytes_written += size;
+    } else {
+      AtomicAddI32(&sink->failed_count, 1);
+    }
+    sink->frames_written++;
+
+    PlatformSignalSemaphore(&sink->free_slots);
+  }
+}
+
+// Frames are max_width x max_height at most, the slots are pushed onto
+// the arena. Returns false if they don't fit, nothing is written then
+internal bool32 StartFrameSink(FrameSink *sink, MemoryArena *arena,
+                               int max_width, int max_height,
+                               FrameSinkFormat format,
+                               FrameSinkWriteCallback *write,
+                               void *write_data) {
+  *sink = {};
+  sink->format = format;
+  sink->write = write;
+  sink->write_data = write_data;
+
+  u64 slot_size = kFrameSinkHeaderSize + (u64)max_width * max_height *
+                                             GetFrameSinkPixelSize(format);
+  bool32 result = true;
+  for (int i = 0; result && i < kFrameSinkSlotCount; ++i) {
+    sink->slots[i].memory = (u8 *)PushSize(arena, slot_size);
+    result = sink->slots[i].memory != 0;
+  }
+  if (result && format == FrameSink_QOI) {
+    sink->encoded = (u8 *)PushSize(arena, GetMaxQOISize(max_width,
+                                                        max_height));
+    result = sink->encoded != 0;
+  }
+  if (!result) return false;
+
+  PlatformInitSemaphore(&sink->free_slots, kFrameSinkSlotCount);
+  PlatformInitSemaphore(&sink->full_slots, 0);
+  PlatformStartThread(WriteSinkFrames, sink);
+  return true;
+}
+
+// Copies the frame out of the buffer, which can be drawn into again right
+// away. Only one thread may submit
+internal void SubmitFrame(FrameSink *sink, GameOffscreenBuffer *buffer) {
+  TIMED_BLOCK(SubmitFrame);
+  u64 wait_start = PlatformGetWallClock();
+  PlatformWaitForSemaphore(&sink->free_slots);
+  sink->wait_ns += PlatformGetWallClock() - wait_start;
+
+  FrameSinkSlot *slot =
+      &sink->slots[sink->frames_submitted % kFrameSinkSlotCount];
+  slot->width = buffer->width;
+  slot->height = buffer->height;
+  slot->frame_index = sink->frames_submitted;
+
+  // The backbuffer is top-down, same as all the formats
+  int pixel_size = GetFrameSinkPixelSize(sink->format);
+  int pitch = buffer->width * buffer->bytes_per_pixel;
+  u8 *out = slot->memory + kFrameSinkHeaderSize;
+  for (int y = 0; y < buffer->height; ++y) {
+    u32 *row = (u32 *)((u8 *)buffer->memory + y * pitch);
+    if (pixel_size == 4) {
+      ConvertToOpaqueBGRA(row, buffer->width, (u32 *)out);
+    } else {
+      ConvertBGRAToRGB(row, buffer->width, out);
+    }
+    out += buffer->width * pixel_size;
+  }
+  sink->frames_submitted++;
+
+  PlatformSignalSemaphore(&sink->full_slots);
+}
+
+// Waits until every frame submitted so far has been written
+internal void FinishFrameSink(FrameSink *sink) {
+  for (int i = 0; i < kFrameSinkSlotCount; ++i) {
+    PlatformWaitForSemaphore(&sink->free_slots);
+  }
+  for (int i = 0; i < kFrameSinkSlotCount; ++i) {
+    PlatformSignalSemaphore(&sink->free_slots);
+  }
+}
+
+#endif  // RENDERER_SINK_CPP
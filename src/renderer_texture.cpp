@@ -0,0 +1,135 @@
+#ifndef RENDERER_TEXTURE_CPP
+#define RENDERER_TEXTURE_CPP
+
+// Textures.
+//
+// Every mip level is stored in 4x4 tiles of 16 texels, 64 bytes or one
+// cache line each, so texels that are close on the screen are close in
+// memory whichever way the texture runs across it.
+//
+// Texture coordinates are in texels of level 0, and the same texel in
+// level L is at (u >> L, v >> L). For that to stay inside the texture,
+// level L is ((width - 1) >> L) + 1 texels wide, which is half the size
+// rounded up. Level texels are box filtered from the level above.
+//
+// The uv mapping is affine across a triangle, so one level per triangle
+// fits all of its pixels. It's picked from the ratio of texture area to
+// screen area, like GL_NEAREST_MIPMAP_NEAREST.
+
+const int kTextureTileShift = 2;
+const int kTextureTileSize = 1 << kTextureTileShift;
+const int kTextureTileMask = kTextureTileSize - 1;
+
+inline u32 *GetTexel(TextureLevel *level, int u, int v) {
+  int tile = (v >> kTextureTileShift) * level->tiles_x +
+             (u >> kTextureTileShift);
+  u32 *result = level->texels +
+                (tile << (2 * kTextureTileShift)) +
+                ((v & kTextureTileMask) << kTextureTileShift) +
+                (u & kTextureTileMask);
+  return result;
+}
+
+// Coordinates outside [0, 1] are clamped to the edge texels, u = 1.0
+// included, and don't repeat. The texture is interpolated across the
+// triangle from its corners, which wrapping them wouldn't keep right
+inline v2i GetTexelCoords(v2 uv, Texture *texture) {
+  r32 u = Min(Max(uv.x, 0.0f), 1.0f);
+  r32 v = Min(Max(uv.y, 0.0f), 1.0f);
+  v2i result;
+  result.x = Max(Min((int)(u * texture->width), texture->width - 1), 0);
+  result.y = Max(Min((int)(v * texture->height), texture->height - 1), 0);
+  return result;
+}
+
+// texel_area and pixel_area are of the same triangle in level 0 texels
+// and on the screen. Level L is picked when it's the closest to one texel
+// per pixel, that is when 4^(L - 1/2) <= texel_area / pixel_area
+internal int SelectTextureLevel(Texture *texture, r32 texel_area,
+                                r32 pixel_area) {
+  if (g_render_settings.base_level_only || pixel_area <= 0) return 0;
+
+  r32 ratio = texel_area / pixel_area;
+  int result = 0;
+  r32 next_level_ratio = 2.0f;
+  while (result + 1 < texture->level_count && ratio >= next_level_ratio) {
+    result++;
+    next_level_ratio *= 4.0f;
+  }
+  return result;
+}
+
+// The levels are pushed onto the arena. Returns false if they don't fit
+// or the image is empty, because it couldn't be read. The texture has no
+// levels then, and nothing may sample it
+internal bool32 LoadTexture(Texture *texture, MemoryArena *arena,
+                            TGAImage *image) {
+  *texture = {};
+  if (image->width <= 0 || image->height <= 0) return false;
+  texture->width = image->width;
+  texture->height = image->height;
+
+  // Level sizes first, so they can share one allocation
+  u64 texel_count = 0;
+  int level_count = 0;
+  for (;;) {
+    TextureLevel *level = &texture->levels[level_count++];
+    level->width = ((texture->width - 1) >> (level_count - 1)) + 1;
+    level->height = ((texture->height - 1) >> (level_count - 1)) + 1;
+    level->tiles_x = (level->width + kTextureTileMask) >> kTextureTileShift;
+    int tiles_y = (level->height + kTextureTileMask) >> kTextureTileShift;
+    texel_count += (u64)level->tiles_x * tiles_y * kTextureTileSize *
+                   kTextureTileSize;
+
+    if (level->width == 1 && level->height == 1) break;
+    if (level_count == kMaxTextureLevels) break;
+  }
+  texture->level_count = level_count;
+
+  texture->memory_size = sizeof(u32) * texel_count;
+  texture->memory = (u32 *)PushZeroSize(arena, texture->memory_size);
+  if (!texture->memory) return false;
+  u32 *texels = texture->memory;
+  for (int i = 0; i < level_count; ++i) {
+    TextureLevel *level = &texture->levels[i];
+    level->texels = texels;
+    int tiles_y = (level->height + kTextureTileMask) >> kTextureTileShift;
+    texels += level->tiles_x * tiles_y * kTextureTileSize * kTextureTileSize;
+  }
+
+  TextureLevel *base = &texture->levels[0];
+  for (int v = 0; v < base->height; ++v) {
+    for (int u = 0; u < base->width; ++u) {
+      TGAColor color = image->get(u, v);
+      *GetTexel(base, u, v) =
+          (u32)color.r << 16 | (u32)color.g << 8 | (u32)color.b;
+    }
+  }
+
+  for (int i = 1; i < level_count; ++i) {
+    TextureLevel *source = &texture->levels[i - 1];
+    TextureLevel *level = &texture->levels[i];
+    for (int v = 0; v < level->height; ++v) {
+      for (int u = 0; u < level->width; ++u) {
+        // Average of the 2x2 texels above, the odd edge is repeated
+        int u0 = 2 * u;
+        int v0 = 2 * v;
+        int u1 = Min(u0 + 1, source->width - 1);
+        int v1 = Min(v0 + 1, source->height - 1);
+        u32 quad[4] = {*GetTexel(source, u0, v0), *GetTexel(source, u1, v0),
+                       *GetTexel(source, u0, v1), *GetTexel(source, u1, v1)};
+
+        u32 color = 0;
+        for (int shift = 0; shift < 24; shift += 8) {
+          u32 sum = 2;  // rounds to nearest
+          for (int j = 0; j < 4; ++j) sum += (quad[j] >> shift) & 0xFF;
+          color |= (sum / 4) << shift;
+        }
+        *GetTexel(level, u, v) = color;
+      }
+    }
+  }
+  return true;
+}
+
+#endif  // RENDERER_TEXTURE_CPP
@@ -0,0 +1,178 @@
+#ifndef RENDERER_TILES_CPP
+#define RENDERER_TILES_CPP
+
+// Binned tile renderer.
+// First all faces are set up and binned into the screen tiles they
+// overlap, then the tiles are rasterized in parallel. Every tile is drawn
+// by one thread, which owns that part of the color and depth buffers, and
+// keeps the submission order of its triangles, so the result is the same
+// as drawing the faces one by one.
+
+// Tiles match the coarse depth tiles, so that no two threads share one
+const int kTileSize = kDepthTileSize;
+
+// The arrays are frame scratch, pushed onto the transient arena
+struct TileBins {
+  int tiles_x;
+  int tiles_y;
+
+  HalfSpaceTriangle *triangles;
+  int triangle_count;
+
+  // Bins are stored back to back, bin i is
+  // triangle_indices[tile_offsets[i]] .. triangle_indices[tile_offsets[i+1]]
+  int *tile_offsets;
+  int *tile_cursors;
+
+  int *triangle_indices;
+};
+
+struct TileWork {
+  TileBins *bins;
+  GameOffscreenBuffer *buffer;
+  ShadingMode shading;
+  u32 state;  // of every triangle
+  i32 volatile next_tile;
+};
+
+global PlatformWorkQueue *g_render_queue;
+
+inline Rect2i GetTileRect(TileBins *bins, int tile_index,
+                          GameOffscreenBuffer *buffer) {
+  int tile_x = tile_index % bins->tiles_x;
+  int tile_y = tile_index / bins->tiles_x;
+
+  Rect2i result;
+  result.min_x = tile_x * kTileSize;
+  result.min_y = tile_y * kTileSize;
+  result.max_x = Min(result.min_x + kTileSize, buffer->width) - 1;
+  result.max_y = Min(result.min_y + kTileSize, buffer->height) - 1;
+
+  return result;
+}
+
+// Returns false if the bins don't fit in the arena
+internal bool32 BinTriangles(TileBins *bins, MemoryArena *arena) {
+  TIMED_BLOCK(BinTriangles);
+  int tile_count = bins->tiles_x * bins->tiles_y;
+
+  for (int i = 0; i <= tile_count; ++i) {
+    bins->tile_offsets[i] = 0;
+  }
+
+  // Count triangles per tile
+  int index_count = 0;
+  for (int i = 0; i < bins->triangle_count; ++i) {
+    Rect2i bounds = bins->triangles[i].bounds;
+    for (int y = bounds.min_y / kTileSize; y <= bounds.max_y / kTileSize;
+         ++y) {
+      for (int x = bounds.min_x / kTileSize; x <= bounds.max_x / kTileSize;
+           ++x) {
+        bins->tile_offsets[y * bins->tiles_x + x + 1]++;
+        index_count++;
+      }
+    }
+  }
+
+  // Prefix sum gives where each bin starts
+  for (int i = 0; i < tile_count; ++i) {
+    bins->tile_offsets[i + 1] += bins->tile_offsets[i];
+    bins->tile_cursors[i] = bins->tile_offsets[i];
+  }
+
+  bins->triangle_indices = PushArray(arena, index_count, int);
+  if (!bins->triangle_indices) return false;
+
+  // Fill the bins in submission order
+  for (int i = 0; i < bins->triangle_count; ++i) {
+    Rect2i bounds = bins->triangles[i].bounds;
+    for (int y = bounds.min_y / kTileSize; y <= bounds.max_y / kTileSize;
+         ++y) {
+      for (int x = bounds.min_x / kTileSize; x <= bounds.max_x / kTileSize;
+           ++x) {
+        bins->triangle_indices[bins->tile_cursors[y * bins->tiles_x + x]++] =
+            i;
+      }
+    }
+  }
+  return true;
+}
+
+internal void DrawTileTriangles(TileBins *bins, int tile_index,
+                                GameOffscreenBuffer *buffer,
+                                Rect2i clip_rect, RasterPass pass) {
+  for (int i = bins->tile_offsets[tile_index];
+       i < bins->tile_offsets[tile_index + 1]; ++i) {
+    HalfSpaceTriangle *tri = &bins->triangles[bins->triangle_indices[i]];
+    RasterizeHalfSpaceTriangle(tri, buffer, clip_rect, pass);
+  }
+}
+
+internal PLATFORM_WORK_QUEUE_CALLBACK(DrawTilesWork) {
+  TileWork *work = (TileWork *)data;
+  TileBins *bins = work->bins;
+  int tile_count = bins->tiles_x * bins->tiles_y;
+
+  for (;;) {
+    int tile_index = AtomicAddI32(&work->next_tile, 1);
+    if (tile_index >= tile_count) break;
+
+    TIMED_BLOCK(DrawTile);
+    Rect2i clip_rect = GetTileRect(bins, tile_index, work->buffer);
+    if (work->shading == Shading_DepthPrepass) {
+      DrawTileTriangles(bins, tile_index, work->buffer, clip_rect,
+                        RasterPass_DepthOnly);
+      LowerTileDepth(work->buffer, clip_rect);
+    }
+    RasterPass pass = work->shading == Shading_Visibility
+                          ? RasterPass_TriangleId
+                          : RasterPass_Shade;
+    DrawTileTriangles(bins, tile_index, work->buffer, clip_rect, pass);
+    if (work->shading == Shading_Visibility) {
+      ResolveVisibility(work->state, bins->triangles, work->buffer,
+                        clip_rect);
+    }
+  }
+}
+
+// Draws the tiles on thread_count threads, the calling one included.
+// Every triangle has the given state, which can't blend unless the
+// shading is forward
+internal void DrawTiles(TileBins *bins, GameOffscreenBuffer *buffer,
+                        int thread_count, ShadingMode shading, u32 state) {
+  TIMED_BLOCK(DrawTiles);
+  TileWork work = {};
+  work.bins = bins;
+  work.buffer = buffer;
+  work.shading = shading;
+  work.state = state;
+
+  if (!g_render_queue || thread_count <= 1) {
+    DrawTilesWork(0, &work);
+    return;
+  }
+
+  for (int i = 0; i < thread_count; ++i) {
+    PlatformAddWorkEntry(g_render_queue, DrawTilesWork, &work);
+  }
+  PlatformCompleteAllWork(g_render_queue);
+}
+
+// Returns false if the bins don't fit in the arena
+internal bool32 ResetTileBins(TileBins *bins, MemoryArena *arena,
+                              GameOffscreenBuffer *buffer,
+                              int max_triangle_count) {
+  bins->tiles_x = (buffer->width + kTileSize - 1) / kTileSize;
+  bins->tiles_y = (buffer->height + kTileSize - 1) / kTileSize;
+  int tile_count = bins->tiles_x * bins->tiles_y;
+
+  bins->tile_offsets = PushArray(arena, tile_count + 1, int);
+  bins->tile_cursors = PushArray(arena, tile_count + 1, int);
+  bins->triangles = PushArray(arena, max_triangle_count, HalfSpaceTriangle);
+  bins->triangle_count = 0;
+
+  bool32 result = bins->tile_offsets && bins->tile_cursors && bins->triangles;
+  return result;
+}
+
+#endif  // RENDERER_TILES_CPP
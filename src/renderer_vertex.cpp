@@ -0,0 +1,183 @@
+#ifndef RENDERER_VERTEX_CPP
+#define RENDERER_VERTEX_CPP
+
+// Vertex stage.
+// Every model vertex is mapped to the screen once per frame, and the faces
+// look their corners up by index instead of transforming them again.
+// The screen positions are kept as separate x, y and z arrays, padded to a
+// multiple of 4 so they can be processed 4 at a time. They are frame
+// scratch, pushed onto the transient arena.
+//
+// x and y are whole pixels, or fixed point with subpixel_bits fractional
+// bits rounded to the nearest step. z is always whole.
+//
+// With a camera distance c the vertices are seen in perspective from
+// (0, 0, c), and w = 1 - z / c. Without one w is 1. Views from elsewhere
+// turn the vertices first, see RenderView. Nothing is clipped: vertices
+// behind the near plane get an inv_w of 0 and their faces and edges are
+// dropped, and the positions are clamped to the guard band.
+
+// w of the near plane, a little in front of the camera
+const r32 kNearPlaneW = 1.0f / 64.0f;
+
+struct ScreenVertices {
+  int *x;
+  int *y;
+  int *z;
+  r32 *inv_w;
+  int count;
+  int capacity;  // per array
+};
+
+// Turns the model into the view, the rows are the axes of the view in
+// model space
+struct ViewRotation {
+  v3 x;
+  v3 y;
+  v3 z;
+};
+
+// Turns by yaw degrees around y and then by pitch degrees around x
+inline ViewRotation GetViewRotation(r32 yaw, r32 pitch) {
+  r32 yaw_radians = yaw * (3.14159265f / 180.0f);
+  r32 pitch_radians = pitch * (3.14159265f / 180.0f);
+  r32 cos_yaw = cosf(yaw_radians);
+  r32 sin_yaw = sinf(yaw_radians);
+  r32 cos_pitch = cosf(pitch_radians);
+  r32 sin_pitch = sinf(pitch_radians);
+
+  ViewRotation result;
+  result.x = {cos_yaw, 0, sin_yaw};
+  result.y = {sin_pitch * sin_yaw, cos_pitch, -sin_pitch * cos_yaw};
+  result.z = {-cos_pitch * sin_yaw, sin_pitch, cos_pitch * cos_yaw};
+  return result;
+}
+
+inline v3 RotateToView(ViewRotation *rotation, v3 vector) {
+  v3 result;
+  result.x = DotProduct(rotation->x, vector);
+  result.y = DotProduct(rotation->y, vector);
+  result.z = DotProduct(rotation->z, vector);
+  return result;
+}
+
+inline v3 RotateToModel(ViewRotation *rotation, v3 vector) {
+  v3 result = rotation->x * vector.x + rotation->y * vector.y +
+              rotation->z * vector.z;
+  return result;
+}
+
+internal void RotateVertices(ViewRotation *rotation, v3 *vertices, v3 *out,
+                             int count) {
+  for (int i = 0; i < count; ++i) {
+    out[i] = RotateToView(rotation, vertices[i]);
+  }
+}
+
+// Maps [-1, 1] to [0, height], clamped to limit either way. With scale 1
+// and round 0 the pixel is truncated, which is what the integer
+// rasterizers expect
+inline int ToScreen(r32 value, int height, r32 scale, r32 round,
+                    r32 limit) {
+  r32 position = (value + 1.0f) * height / 2.0f * scale + round;
+  int result = static_cast<int>(Min(Max(position, -limit), limit));
+  return result;
+}
+
+// Returns false if the arrays don't fit in the arena
+internal bool32 TransformVertices(ScreenVertices *screen, MemoryArena *arena,
+                                  v3 *vertices, int count, int height,
+                                  int subpixel_bits, r32 camera_distance) {
+  TIMED_BLOCK(TransformVertices);
+  r32 scale = (r32)(1 << subpixel_bits);
+  r32 round = subpixel_bits ? 0.5f : 0.0f;
+  // w = 1 + z * projection, which is exactly 1 without a camera
+  r32 projection = camera_distance > 0 ? -1.0f / camera_distance : 0.0f;
+  r32 xy_limit = (r32)kScreenGuardBand * scale;
+  r32 z_limit = (r32)kScreenGuardBand;
+
+  int capacity = (count + 3) & ~3;
+  int *memory = PushArray(arena, 4 * capacity, int);
+  if (!memory) return false;
+  screen->x = memory;
+  screen->y = screen->x + capacity;
+  screen->z = screen->y + capacity;
+  screen->inv_w = (r32 *)(screen->z + capacity);
+  screen->count = count;
+  screen->capacity = capacity;
+
+  int i = 0;
+#if RASTER_SIMD_WIDTH >= 4
+  // Same operations as ToScreen, 4 vertices at a time. The loads take
+  // 4 interleaved vertices (12 floats) and split them into x, y and z
+  __m128 one = _mm_set1_ps(1.0f);
+  __m128 pixels = _mm_set1_ps((r32)height);
+  __m128 two = _mm_set1_ps(2.0f);
+  __m128 xy_scale = _mm_set1_ps(scale);
+  __m128 xy_round = _mm_set1_ps(round);
+  __m128 projection_4 = _mm_set1_ps(projection);
+  __m128 near_w = _mm_set1_ps(kNearPlaneW);
+  __m128 xy_max = _mm_set1_ps(xy_limit);
+  __m128 xy_min = _mm_set1_ps(-xy_limit);
+  __m128 z_max = _mm_set1_ps(z_limit);
+  __m128 z_min = _mm_set1_ps(-z_limit);
+  for (; i + 4 <= count; i += 4) {
+    r32 *source = &vertices[i].x;
+    __m128 a = _mm_loadu_ps(source);      // x0 y0 z0 x1
+    __m128 b = _mm_loadu_ps(source + 4);  // y1 z1 x2 y2
+    __m128 c = _mm_loadu_ps(source + 8);  // z2 x3 y3 z3
+
+    __m128 x23 = _mm_shuffle_ps(b, c, _MM_SHUFFLE(0, 1, 0, 2));
+    __m128 x = _mm_shuffle_ps(a, x23, _MM_SHUFFLE(2, 0, 3, 0));
+    __m128 y01 = _mm_shuffle_ps(a, b, _MM_SHUFFLE(0, 0, 0, 1));
+    __m128 y23 = _mm_shuffle_ps(b, c, _MM_SHUFFLE(0, 2, 0, 3));
+    __m128 y = _mm_shuffle_ps(y01, y23, _MM_SHUFFLE(2, 0, 2, 0));
+    __m128 z01 = _mm_shuffle_ps(a, b, _MM_SHUFFLE(0, 1, 0, 2));
+    __m128 z23 = _mm_shuffle_ps(c, c, _MM_SHUFFLE(0, 3, 0, 0));
+    __m128 z = _mm_shuffle_ps(z01, z23, _MM_SHUFFLE(2, 0, 2, 0));
+
+    __m128 w = _mm_add_ps(_mm_mul_ps(z, projection_4), one);
+    __m128 inv_w = _mm_div_ps(one, _mm_max_ps(w, near_w));
+    x = _mm_mul_ps(x, inv_w);
+    y = _mm_mul_ps(y, inv_w);
+    z = _mm_mul_ps(z, inv_w);
+    _mm_storeu_ps(screen->inv_w + i,
+                  _mm_and_ps(inv_w, _mm_cmpge_ps(w, near_w)));
+
+    x = _mm_div_ps(_mm_mul_ps(_mm_add_ps(x, one), pixels), two);
+    y = _mm_div_ps(_mm_mul_ps(_mm_add_ps(y, one), pixels), two);
+    z = _mm_div_ps(_mm_mul_ps(_mm_add_ps(z, one), pixels), two);
+    x = _mm_add_ps(_mm_mul_ps(x, xy_scale), xy_round);
+    y = _mm_add_ps(_mm_mul_ps(y, xy_scale), xy_round);
+    x = _mm_min_ps(_mm_max_ps(x, xy_min), xy_max);
+    y = _mm_min_ps(_mm_max_ps(y, xy_min), xy_max);
+    z = _mm_min_ps(_mm_max_ps(z, z_min), z_max);
+
+    _mm_storeu_si128((__m128i *)(screen->x + i), _mm_cvttps_epi32(x));
+    _mm_storeu_si128((__m128i *)(screen->y + i), _mm_cvttps_epi32(y));
+    _mm_storeu_si128((__m128i *)(screen->z + i), _mm_cvttps_epi32(z));
+  }
+#endif
+  for (; i < count; ++i) {
+    v3 vertex = vertices[i];
+    r32 w = vertex.z * projection + 1.0f;
+    r32 inv_w = 1.0f / Max(w, kNearPlaneW);
+    screen->x[i] =
+        ToScreen(vertex.x * inv_w, height, scale, round, xy_limit);
+    screen->y[i] =
+        ToScreen(vertex.y * inv_w, height, scale, round, xy_limit);
+    screen->z[i] = ToScreen(vertex.z * inv_w, height, 1.0f, 0.0f, z_limit);
+    screen->inv_w[i] = w >= kNearPlaneW ? inv_w : 0.0f;
+  }
+  return true;
+}
+
+inline v3i GetScreenVertex(ScreenVertices *screen, int index) {
+  v3i result;
+  result.x = screen->x[index];
+  result.y = screen->y[index];
+  result.z = screen->z[index];
+  return result;
+}
+
+#endif  // RENDERER_VERTEX_CPP
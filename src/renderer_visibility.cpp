@@ -0,0 +1,161 @@
+#ifndef RENDERER_VISIBILITY_CPP
+#define RENDERER_VISIBILITY_CPP
+
+// Visibility buffer.
+// Forward rendering shades a pixel every time a triangle passes the depth
+// test there, so with overdraw most texture fetches and color writes are
+// thrown away again. Here the triangles of a tile are first drawn with
+// RasterPass_TriangleId, which only tests and writes depth and leaves the
+// index of the triangle in the color buffer. Then the tile is walked in
+// screen order and every covered pixel is shaded once, by the triangle it
+// ended up with.
+//
+// The attributes of a pixel are computed the same way the rasterizer does
+// it, from the start of the triangle's block row and with the same float
+// operations in the same order, so the frame is identical to the forward
+// one. Blending needs every layer, those frames are drawn forward.
+
+// Attributes at the start of the first row the rasterizer draws in the
+// block, returns that row
+template <u32 kState>
+inline int StartHalfSpaceRow(HalfSpaceTriangle *tri, int block_x,
+                             int block_y, HalfSpaceRow *row) {
+  int y0 = Max(block_y, tri->bounds.min_y);
+
+  int sample_x = (block_x << tri->subpixel_bits) + tri->sample_offset;
+  int sample_y = (block_y << tri->subpixel_bits) + tri->sample_offset;
+  r32 dx = (sample_x - tri->p[0].x) * tri->subpixel_size;
+  r32 dy = (sample_y - tri->p[0].y) * tri->subpixel_size + (y0 - block_y);
+  if (kState & RasterState_Textured) {
+    row->u = tri->u0 + tri->du_dx * dx + tri->du_dy * dy;
+    row->v = tri->v0 + tri->dv_dx * dx + tri->dv_dy * dy;
+    row->q = tri->q0 + tri->dq_dx * dx + tri->dq_dy * dy;
+  }
+  if (kState & RasterState_Gouraud) {
+    row->i = tri->i0 + tri->di_dx * dx + tri->di_dy * dy;
+  }
+  return y0;
+}
+
+// Steps the attributes down the rows one by one, as the rasterizer does
+template <u32 kState>
+inline void AdvanceHalfSpaceRow(HalfSpaceTriangle *tri, HalfSpaceRow *row,
+                                int row_count) {
+  for (int i = 0; i < row_count; ++i) {
+    if (kState & RasterState_Textured) {
+      row->u += tri->du_dy;
+      row->v += tri->dv_dy;
+      row->q += tri->dq_dy;
+    }
+    if (kState & RasterState_Gouraud) row->i += tri->di_dy;
+  }
+}
+
+// Row attributes of a triangle in the block, kept from one row to the next
+struct ResolveRow {
+  HalfSpaceTriangle *tri;
+  int y;
+  HalfSpaceRow row;
+};
+
+const int kResolveRowCacheSize = 8;  // power of two
+
+// Shades the pixels of the tile from the triangle indices in the color
+// buffer. kState is the state of the triangles without the depth flags
+template <u32 kState>
+internal void ResolveVisibilityTile(HalfSpaceTriangle *triangles,
+                                    GameOffscreenBuffer *buffer,
+                                    Rect2i tile_rect) {
+  int tiles_x = GetDepthTilesX(buffer);
+  DepthTile *tile =
+      &buffer->depth_tiles[(tile_rect.min_y / kDepthTileSize) * tiles_x +
+                           tile_rect.min_x / kDepthTileSize];
+  if (tile->generation != buffer->generation) return;  // nothing drawn
+
+  bool32 simd = !g_render_settings.scalar_only;
+  RasterCounts counts = {};
+  for (int block_y = tile_rect.min_y; block_y <= tile_rect.max_y;
+       block_y += kBlockSize) {
+    for (int block_x = tile_rect.min_x; block_x <= tile_rect.max_x;
+         block_x += kBlockSize) {
+      if (GetDepthBlock(buffer, block_x, block_y)->z_max == INT_MIN) {
+        continue;  // nothing drawn
+      }
+
+      ResolveRow rows[kResolveRowCacheSize] = {};
+      int count = Min(block_x + kBlockSize, tile_rect.max_x + 1) - block_x;
+      int y1 = Min(block_y + kBlockSize - 1, tile_rect.max_y);
+      for (int y = block_y; y <= y1; ++y) {
+        u32 *pixel = GetPixel(buffer, block_x, y);
+        int *depth = buffer->z_buffer + y * buffer->width + block_x;
+
+        // Runs of pixels from the same triangle are shaded together, a
+        // whole row of the block in the SIMD kernel
+        int lane = 0;
+        while (lane < count) {
+          if (depth[lane] == INT_MIN) {
+            lane++;
+            continue;
+          }
+          int end = lane + 1;
+          while (end < count && pixel[end] == pixel[lane] &&
+                 depth[end] != INT_MIN) {
+            end++;
+          }
+
+          HalfSpaceTriangle *tri = &triangles[pixel[lane]];
+          ResolveRow *cached =
+              &rows[pixel[lane] & (kResolveRowCacheSize - 1)];
+          if (cached->tri != tri) {
+            cached->tri = tri;
+            cached->y =
+                StartHalfSpaceRow<kState>(tri, block_x, block_y, &cached->row);
+          }
+          AdvanceHalfSpaceRow<kState>(tri, &cached->row, y - cached->y);
+          cached->y = y;
+
+          if (simd) {
+            ShadeHalfSpaceSpan<kState>(tri, 0, 0, 0, &cached->row, lane,
+                                       end - lane, true, true, depth + lane,
+                                       pixel + lane, &counts);
+          } else {
+            ShadeHalfSpaceSpanScalar<kState>(
+                tri, 0, 0, 0, &cached->row, lane, end - lane, true, true,
+                depth + lane, pixel + lane, &counts);
+          }
+          lane = end;
+        }
+      }
+    }
+  }
+  DEBUG_COUNT(PixelsShaded, counts.passed);
+}
+
+// Blending isn't resolved, so only the states that shade differently
+#define RESOLVE_VISIBILITY_CASE(shade_state)                            \
+  case (shade_state):                                                   \
+    ResolveVisibilityTile<(shade_state)>(triangles, buffer, tile_rect); \
+    break;
+
+internal void ResolveVisibility(u32 state, HalfSpaceTriangle *triangles,
+                                GameOffscreenBuffer *buffer,
+                                Rect2i tile_rect) {
+  TIMED_BLOCK(ResolveVisibility);
+  const u32 T = RasterState_Textured;
+  const u32 G = RasterState_Gouraud;
+  const u32 P = RasterState_Perspective;
+  switch (state & (T | G | P)) {
+    RESOLVE_VISIBILITY_CASE(0)
+    RESOLVE_VISIBILITY_CASE(T)
+    RESOLVE_VISIBILITY_CASE(G)
+    RESOLVE_VISIBILITY_CASE(T | G)
+    RESOLVE_VISIBILITY_CASE(P)
+    RESOLVE_VISIBILITY_CASE(T | P)
+    RESOLVE_VISIBILITY_CASE(G | P)
+    RESOLVE_VISIBILITY_CASE(T | G | P)
+  }
+}
+
+#undef RESOLVE_VISIBILITY_CASE
+
+#endif  // RENDERER_VISIBILITY_CPP
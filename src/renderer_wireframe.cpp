@@ -0,0 +1,216 @@
+#ifndef RENDERER_WIREFRAME_CPP
+#define RENDERER_WIREFRAME_CPP
+
+// Lines and the wireframe.
+//
+// A line is clipped to the rectangle before anything is drawn. Lines that
+// lie entirely on one side of it are rejected by their Cohen-Sutherland
+// outcodes, the others get the range of steps that is inside computed
+// from the line equation, so the pixels outside are never visited. The
+// clipped line draws exactly the pixels of the unclipped one inside the
+// rectangle. The pixel pointer is stepped along the line, and the pixels
+// between two steps of the minor axis are written as one run, a span of a
+// row for the flat lines.
+//
+// The wireframe draws every edge of the model once, from the edge list
+// built at load. On several threads the screen is split into bands of
+// rows and each thread clips all the edges to its own band, so no pixel
+// is written by two threads.
+
+const u32 kWireframeColor = 0x0000FF00;
+
+enum Outcode {
+  Outcode_Left = 1,
+  Outcode_Right = 2,
+  Outcode_Bottom = 4,
+  Outcode_Top = 8,
+};
+
+inline u32 GetOutcode(int x, int y, Rect2i rect) {
+  u32 result = 0;
+  if (x < rect.min_x) result |= Outcode_Left;
+  if (x > rect.max_x) result |= Outcode_Right;
+  if (y < rect.min_y) result |= Outcode_Bottom;
+  if (y > rect.max_y) result |= Outcode_Top;
+  return result;
+}
+
+// Draws from x0, y0 to x1, y1 where it's inside clip_rect, which has to
+// be inside the buffer. Both ends are drawn. The minor axis steps as soon
+// as the error is positive, so the line leaves the row or column of x0,
+// y0 one pixel in
+internal void DrawLine(GameOffscreenBuffer *buffer, int x0, int y0, int x1,
+                       int y1, u32 color, Rect2i clip_rect) {
+  u32 outcode0 = GetOutcode(x0, y0, clip_rect);
+  u32 outcode1 = GetOutcode(x1, y1, clip_rect);
+  if (outcode0 & outcode1) return;  // all outside one edge of the rect
+
+  // Walk along the major axis a, from a0 up to a1, b is the minor axis
+  bool32 steep = Abs(x1 - x0) < Abs(y1 - y0);
+  int a0 = steep ? y0 : x0;
+  int b0 = steep ? x0 : y0;
+  int a1 = steep ? y1 : x1;
+  int b1 = steep ? x1 : y1;
+  if (a0 > a1) {
+    swap_int(&a0, &a1);
+    swap_int(&b0, &b1);
+  }
+  int min_a = steep ? clip_rect.min_y : clip_rect.min_x;
+  int max_a = steep ? clip_rect.max_y : clip_rect.max_x;
+  int min_b = steep ? clip_rect.min_x : clip_rect.min_y;
+  int max_b = steep ? clip_rect.max_x : clip_rect.max_y;
+
+  // The minor step count at step k of the major axis is
+  // n(k) = floor((k * d + two_da - 2) / two_da)
+  i64 da = (i64)a1 - a0;
+  i64 d = 2 * ((i64)b1 - b0);
+  int b_step = d < 0 ? -1 : 1;
+  if (d < 0) d = -d;
+  i64 two_da = 2 * da;
+
+  i64 first = 0;
+  i64 last = da;
+  if (outcode0 | outcode1) {
+    first = Max(first, (i64)min_a - a0);
+    last = Min(last, (i64)max_a - a0);
+
+    // n(k) has to stay within [min_n, max_n] for b to be inside
+    i64 min_n = b_step > 0 ? (i64)min_b - b0 : (i64)b0 - max_b;
+    i64 max_n = b_step > 0 ? (i64)max_b - b0 : (i64)b0 - min_b;
+    if (max_n < 0) return;
+    if (min_n > 0) {
+      if (d == 0) return;
+      first = Max(first, (two_da * (min_n - 1) + 2 + d - 1) / d);
+    }
+    if (d > 0) last = Min(last, (two_da * max_n + 1) / d);
+  }
+  if (first > last) return;
+
+  i64 n = da > 0 ? (first * d + two_da - 2) / two_da : 0;
+  i64 error = first * d - n * two_da;
+  int a = a0 + (int)first;
+  int b = b0 + b_step * (int)n;
+  u32 *pixel = steep ? GetPixel(buffer, b, a) : GetPixel(buffer, a, b);
+
+  // Pixel steps along the axes, y goes up the screen and down in memory
+  int a_step = steep ? -buffer->width : 1;
+  int minor_step = steep ? b_step : -b_step * buffer->width;
+
+  // A run ends with the pixel that makes the error positive. The first one
+  // can be cut short by the clipping, the ones after it are all q or q + 1
+  // pixels long
+  i64 remaining = last - first + 1;
+  i64 q = d > 0 ? two_da / d : 0;
+  if (q == 1) {
+    // Runs of one or two pixels, cheaper stepped one by one
+    for (i64 i = 0; i < remaining; ++i) {
+      *pixel = color;
+      pixel += a_step;
+      error += d;
+      if (error > 1) {
+        pixel += minor_step;
+        error -= two_da;
+      }
+    }
+    return;
+  }
+  i64 run = d > 0 ? (1 - error) / d + 1 : remaining;
+  for (;;) {
+    run = Min(run, remaining);
+    if (steep) {
+      for (i64 i = 0; i < run; ++i) {
+        *pixel = color;
+        pixel += a_step;
+      }
+    } else {
+      for (i64 i = 0; i < run; ++i) pixel[i] = color;
+      pixel += run;
+    }
+    remaining -= run;
+    if (remaining == 0) break;
+    pixel += minor_step;
+    error += run * d - two_da;
+    run = error + q * d > 1 ? q : q + 1;
+  }
+}
+
+internal void DebugLine(GameOffscreenBuffer *buffer, int x0, int y0, int x1,
+                        int y1, u32 color) {
+  if (buffer->width <= 0 || buffer->height <= 0) return;
+  Rect2i rect = {0, 0, buffer->width - 1, buffer->height - 1};
+  DrawLine(buffer, x0, y0, x1, y1, color, rect);
+}
+
+struct WireframeWork {
+  GameOffscreenBuffer *buffer;
+  ScreenVertices *screen;
+  Edge *edges;
+  int edge_count;
+  int subpixel_bits;
+  u32 color;
+
+  int band_count;
+  i32 volatile next_band;
+};
+
+internal PLATFORM_WORK_QUEUE_CALLBACK(DrawWireframeWork) {
+  WireframeWork *work = (WireframeWork *)data;
+  GameOffscreenBuffer *buffer = work->buffer;
+  int *xs = work->screen->x;
+  int *ys = work->screen->y;
+  r32 *inv_ws = work->screen->inv_w;
+  int shift = work->subpixel_bits;
+
+  for (;;) {
+    int band = AtomicAddI32(&work->next_band, 1);
+    if (band >= work->band_count) break;
+
+    int height = buffer->height;
+    Rect2i rect = {0, 0, buffer->width - 1, 0};
+    rect.min_y = (int)((i64)height * band / work->band_count);
+    rect.max_y = (int)((i64)height * (band + 1) / work->band_count) - 1;
+    for (int i = 0; i < work->edge_count; ++i) {
+      int v0 = work->edges[i].v[0];
+      int v1 = work->edges[i].v[1];
+      if (inv_ws[v0] <= 0 || inv_ws[v1] <= 0) continue;  // behind the camera
+      DrawLine(buffer, xs[v0] >> shift, ys[v0] >> shift, xs[v1] >> shift,
+               ys[v1] >> shift, work->color, rect);
+    }
+  }
+}
+
+// Draws the edges between the screen vertices over the color buffer,
+// without depth, on thread_count threads. Lines go into tiles that may
+// not have been drawn into this frame, so it comes after ResolveBuffer
+internal void DrawWireframe(GameOffscreenBuffer *buffer, ScreenVertices *screen,
+                            Edge *edges, int edge_count, int subpixel_bits,
+                            u32 color, int thread_count) {
+  TIMED_BLOCK(DrawWireframe);
+  if (!buffer->memory || buffer->width <= 0 || buffer->height <= 0) return;
+
+  WireframeWork work = {};
+  work.buffer = buffer;
+  work.screen = screen;
+  work.edges = edges;
+  work.edge_count = edge_count;
+  work.subpixel_bits = subpixel_bits;
+  work.color = color;
+  work.band_count = Min(Max(thread_count, 1), buffer->height);
+
+  if (!g_render_queue || work.band_count == 1) {
+    DrawWireframeWork(0, &work);
+  } else {
+    for (int i = 0; i < work.band_count; ++i) {
+      PlatformAddWorkEntry(g_render_queue, DrawWireframeWork, &work);
+    }
+    PlatformCompleteAllWork(g_render_queue);
+  }
+
+  // The next frame has to clear the lines wherever it doesn't draw
+  int tile_count = GetDepthTilesX(buffer) * GetDepthTilesY(buffer);
+  for (int i = 0; i < tile_count; ++i) {
+    buffer->depth_tiles[i].has_color = true;
+  }
+}
+
+#endif  // RENDERER_WIREFRAME_CPP
@@ -12,12 +12,22 @@
 
 global bool32 g_running;
 
-global BITMAPINFO g_bitmap_info;
 global LARGE_INTEGER g_performance_frequency;
+global HDC g_window_dc;  // CS_OWNDC, so it's the same one on any thread
 
-global GameOffscreenBuffer g_game_backbuffer;
+void *PlatformAllocateMemory(u64 size) {
+  // Committed pages are zero-initialized
+  void *result = VirtualAlloc(0, size, MEM_COMMIT, PAGE_READWRITE);
+  return result;
+}
 
-FileReadResult PlatformReadEntireFile(char *filename) {
+void PlatformFreeMemory(void *memory, u64 size) {
+  if (memory) VirtualFree(memory, 0, MEM_RELEASE);
+}
+
+// The file is pushed onto the arena, callers pop it with a temporary scope
+FileReadResult PlatformReadEntireFile(const char *filename,
+                                      MemoryArena *arena) {
   FileReadResult result = {};
 
   HANDLE file_handle = CreateFile(filename, GENERIC_READ, FILE_SHARE_READ,
@@ -29,12 +39,16 @@ FileReadResult PlatformReadEntireFile(char *filename) {
     LARGE_INTEGER file_size;
     if (GetFileSizeEx(file_handle, &file_size)) {
       result.memory_size = file_size.QuadPart;
-      result.memory =
-          VirtualAlloc(0, result.memory_size, MEM_COMMIT, PAGE_READWRITE);
+      result.memory = PushSize(arena, result.memory_size);
       DWORD bytes_read = 0;
 
-      ReadFile(file_handle, result.memory, (u32)result.memory_size, &bytes_read,
-               0);
+      if (!result.memory ||
+          !ReadFile(file_handle, result.memory, (u32)result.memory_size,
+                    &bytes_read, 0) ||
+          bytes_read != result.memory_size) {
+        OutputDebugStringA("Cannot read the whole file\n");
+        result = {};
+      }
 
       CloseHandle(file_handle);
 
@@ -43,6 +57,7 @@ FileReadResult PlatformReadEntireFile(char *filename) {
       OutputDebugStringA("Cannot get file size\n");
       // GetLastError() should help
     }
+    CloseHandle(file_handle);
   } else {
     OutputDebugStringA("Cannot read from file\n");
     // GetLastError() should help
@@ -51,47 +66,239 @@ FileReadResult PlatformReadEntireFile(char *filename) {
   return result;
 }
 
-// Above this line are the platform service functions
-#include "renderer.cpp"
+// Read-only view of the whole file, released with PlatformUnmapFile
+FileReadResult PlatformMapFile(const char *filename) {
+  FileReadResult result = {};
+
+  HANDLE file_handle = CreateFile(filename, GENERIC_READ, FILE_SHARE_READ,
+                                  0, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, 0);
+  if (file_handle == INVALID_HANDLE_VALUE) return result;
+
+  LARGE_INTEGER file_size;
+  if (GetFileSizeEx(file_handle, &file_size) && file_size.QuadPart > 0) {
+    HANDLE mapping_handle =
+        CreateFileMapping(file_handle, 0, PAGE_READONLY, 0, 0, 0);
+    if (mapping_handle) {
+      result.memory = MapViewOfFile(mapping_handle, FILE_MAP_READ, 0, 0, 0);
+      if (result.memory) result.memory_size = file_size.QuadPart;
+      // The view keeps the mapping alive
+      CloseHandle(mapping_handle);
+    }
+  }
+  CloseHandle(file_handle);
 
-internal void Win32UpdateWindow(HDC hdc) {
-  StretchDIBits(
-      hdc, 0, 0, g_game_backbuffer.width, g_game_backbuffer.height,  // dest
-      0, 0, g_game_backbuffer.width, g_game_backbuffer.height,       // src
-      g_game_backbuffer.memory, &g_bitmap_info, DIB_RGB_COLORS, SRCCOPY);
+  return result;
 }
 
-internal void Win32ResizeClientWindow(HWND window) {
-  RECT client_rect;
-  GetClientRect(window, &client_rect);
-  int width = client_rect.right - client_rect.left;
-  int height = client_rect.bottom - client_rect.top;
+void PlatformUnmapFile(FileReadResult *file) {
+  if (file->memory) UnmapViewOfFile(file->memory);
+  *file = {};
+}
 
-  if (width > g_game_backbuffer.max_width) width = g_game_backbuffer.max_width;
+// Writes to a temporary file first and moves it over the target, so
+// nobody ever sees a half-written file
+bool32 PlatformWriteEntireFile(const char *filename, void *memory, u64 size) {
+  char temp_filename[MAX_PATH];
+  _snprintf_s(temp_filename, sizeof(temp_filename), _TRUNCATE, "%s.%u.tmp",
+              filename, GetCurrentProcessId());
+
+  HANDLE file_handle = CreateFile(temp_filename, GENERIC_WRITE, 0, 0,
+                                  CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, 0);
+  if (file_handle == INVALID_HANDLE_VALUE) {
+    OutputDebugStringA("Cannot write to file\n");
+    return false;
+  }
 
-  if (height > g_game_backbuffer.max_height)
-    height = g_game_backbuffer.max_height;
+  DWORD bytes_written = 0;
+  bool32 result =
+      WriteFile(file_handle, memory, (u32)size, &bytes_written, 0) &&
+      bytes_written == size;
+  CloseHandle(file_handle);
 
-  g_game_backbuffer.width = width;
-  g_game_backbuffer.height = height;
+  if (result) {
+    result = MoveFileEx(temp_filename, filename, MOVEFILE_REPLACE_EXISTING);
+  }
+  if (!result) DeleteFile(temp_filename);
 
-  g_bitmap_info.bmiHeader.biWidth = width;
-  g_bitmap_info.bmiHeader.biHeight = -height;
+  return result;
 }
 
-inline LARGE_INTEGER Win32GetWallClock() {
-  LARGE_INTEGER result;
-  QueryPerformanceCounter(&result);
+// 0 if the file doesn't exist
+u64 PlatformGetLastWriteTime(const char *filename) {
+  WIN32_FILE_ATTRIBUTE_DATA data;
+  if (!GetFileAttributesEx(filename, GetFileExInfoStandard, &data)) return 0;
 
+  u64 result = (u64)data.ftLastWriteTime.dwHighDateTime << 32 |
+               data.ftLastWriteTime.dwLowDateTime;
   return result;
 }
 
-inline r32 Win32GetMsElapsed(LARGE_INTEGER start, LARGE_INTEGER End) {
-  r32 result = 1000.0f * (r32)(End.QuadPart - start.QuadPart) /
-               (r32)g_performance_frequency.QuadPart;
+void PlatformAddWorkEntry(PlatformWorkQueue *queue,
+                          PlatformWorkQueueCallback *callback, void *data) {
+  u32 new_next_entry_to_write =
+      (queue->next_entry_to_write + 1) % COUNT_OF(queue->entries);
+  Assert(new_next_entry_to_write != queue->next_entry_to_read);
+
+  PlatformWorkQueueEntry *entry = &queue->entries[queue->next_entry_to_write];
+  entry->callback = callback;
+  entry->data = data;
+  ++queue->completion_goal;
+
+  // The entry must be complete before the workers can see it
+  _WriteBarrier();
+  queue->next_entry_to_write = new_next_entry_to_write;
+  ReleaseSemaphore(queue->semaphore_handle, 1, 0);
+}
+
+// Returns true if there was nothing to do
+internal bool32 Win32DoNextWorkQueueEntry(PlatformWorkQueue *queue) {
+  bool32 we_should_sleep = false;
+
+  u32 original_next_entry_to_read = queue->next_entry_to_read;
+  u32 new_next_entry_to_read =
+      (original_next_entry_to_read + 1) % COUNT_OF(queue->entries);
+  if (original_next_entry_to_read != queue->next_entry_to_write) {
+    u32 index = InterlockedCompareExchange(
+        (LONG volatile *)&queue->next_entry_to_read, new_next_entry_to_read,
+        original_next_entry_to_read);
+    if (index == original_next_entry_to_read) {
+      PlatformWorkQueueEntry entry = queue->entries[index];
+      entry.callback(queue, entry.data);
+      InterlockedIncrement((LONG volatile *)&queue->completion_count);
+    }
+  } else {
+    we_should_sleep = true;
+  }
+
+  return we_should_sleep;
+}
+
+void PlatformCompleteAllWork(PlatformWorkQueue *queue) {
+  while (queue->completion_goal != queue->completion_count) {
+    Win32DoNextWorkQueueEntry(queue);
+  }
+
+  queue->completion_goal = 0;
+  queue->completion_count = 0;
+}
+
+DWORD WINAPI Win32ThreadProc(LPVOID parameter) {
+  PlatformWorkQueue *queue = (PlatformWorkQueue *)parameter;
+
+  for (;;) {
+    if (Win32DoNextWorkQueueEntry(queue)) {
+      WaitForSingleObjectEx(queue->semaphore_handle, INFINITE, FALSE);
+    }
+  }
+}
+
+internal void Win32MakeQueue(PlatformWorkQueue *queue, u32 thread_count) {
+  queue->completion_goal = 0;
+  queue->completion_count = 0;
+  queue->next_entry_to_write = 0;
+  queue->next_entry_to_read = 0;
+
+  u32 initial_count = 0;
+  queue->semaphore_handle = CreateSemaphoreEx(0, initial_count, thread_count,
+                                              0, 0, SEMAPHORE_ALL_ACCESS);
+
+  for (u32 i = 0; i < thread_count; ++i) {
+    DWORD thread_id;
+    HANDLE thread_handle =
+        CreateThread(0, 0, Win32ThreadProc, queue, 0, &thread_id);
+    CloseHandle(thread_handle);
+  }
+}
+
+void PlatformInitSemaphore(PlatformSemaphore *semaphore, u32 initial_count) {
+  semaphore->handle = CreateSemaphoreEx(0, initial_count, LONG_MAX, 0, 0,
+                                        SEMAPHORE_ALL_ACCESS);
+}
+
+void PlatformSignalSemaphore(PlatformSemaphore *semaphore) {
+  ReleaseSemaphore(semaphore->handle, 1, 0);
+}
+
+void PlatformWaitForSemaphore(PlatformSemaphore *semaphore) {
+  WaitForSingleObjectEx(semaphore->handle, INFINITE, FALSE);
+}
+
+struct Win32ThreadStart {
+  PlatformThreadProc *proc;
+  void *data;
+};
+
+DWORD WINAPI Win32StartThreadProc(LPVOID parameter) {
+  Win32ThreadStart start = *(Win32ThreadStart *)parameter;
+  VirtualFree(parameter, 0, MEM_RELEASE);
+  start.proc(start.data);
+  return 0;
+}
+
+// The thread runs until the process exits
+void PlatformStartThread(PlatformThreadProc *proc, void *data) {
+  Win32ThreadStart *start = (Win32ThreadStart *)VirtualAlloc(
+      0, sizeof(Win32ThreadStart), MEM_COMMIT, PAGE_READWRITE);
+  start->proc = proc;
+  start->data = data;
+
+  DWORD thread_id;
+  HANDLE thread_handle =
+      CreateThread(0, 0, Win32StartThreadProc, start, 0, &thread_id);
+  CloseHandle(thread_handle);
+}
+
+// Nanoseconds from some fixed point in the past
+u64 PlatformGetWallClock() {
+  LARGE_INTEGER counter;
+  QueryPerformanceCounter(&counter);
+
+  // In two parts, so that the multiplication doesn't overflow
+  u64 frequency = g_performance_frequency.QuadPart;
+  u64 seconds = counter.QuadPart / frequency;
+  u64 rest = counter.QuadPart % frequency;
+  u64 result = seconds * 1000000000ull + rest * 1000000000ull / frequency;
   return result;
 }
 
+// Whole milliseconds at the timer resolution set in WinMain, so it may
+// wake up to a millisecond early
+void PlatformSleep(u64 ns) {
+  DWORD ms = (DWORD)(ns / 1000000ull);
+  if (ms) Sleep(ms);
+}
+
+// Above this line are the platform service functions
+#include "renderer.cpp"
+
+global FrameLoop g_frame_loop;
+
+// Runs on the presenter thread
+internal PRESENT_FRAME(Win32PresentFrame) {
+  TIMED_BLOCK(Present);
+  BITMAPINFO bitmap_info = {};
+  bitmap_info.bmiHeader.biSize = sizeof(bitmap_info.bmiHeader);
+  bitmap_info.bmiHeader.biWidth = buffer->width;
+  bitmap_info.bmiHeader.biHeight = -buffer->height;  // top-down
+  bitmap_info.bmiHeader.biPlanes = 1;
+  bitmap_info.bmiHeader.biBitCount = 32;
+  bitmap_info.bmiHeader.biCompression = BI_RGB;
+
+  StretchDIBits(g_window_dc, 0, 0, buffer->width, buffer->height,  // dest
+                0, 0, buffer->width, buffer->height,               // src
+                buffer->memory, &bitmap_info, DIB_RGB_COLORS, SRCCOPY);
+}
+
+// The buffers pick up the new size when they are drawn into next
+internal void Win32ResizeClientWindow(HWND window) {
+  RECT client_rect;
+  GetClientRect(window, &client_rect);
+  int width = client_rect.right - client_rect.left;
+  int height = client_rect.bottom - client_rect.top;
+
+  SetFrameSize(&g_frame_loop, width, height);
+}
+
 LRESULT CALLBACK
 Win32WindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam) {
   LRESULT result = 0;
@@ -106,10 +313,10 @@ Win32WindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam) {
     } break;
 
     case WM_PAINT: {
+      // The presenter repaints the whole window every frame, a buffer
+      // drawn here could be half way through the next frame
       PAINTSTRUCT Paint = {};
-      HDC hdc = BeginPaint(hwnd, &Paint);
-      Win32UpdateWindow(hdc  // we update the whole window, always
-                        );
+      BeginPaint(hwnd, &Paint);
       EndPaint(hwnd, &Paint);
     } break;
 
@@ -156,7 +363,6 @@ int CALLBACK WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance,
 
   // TODO: query monitor refresh rate
   int target_fps = 30;
-  r32 target_mspf = 1000.0f / (r32)target_fps;  // Target ms per frame
 
   // Set target sleep resolution
   {
@@ -176,6 +382,22 @@ int CALLBACK WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance,
 
   QueryPerformanceFrequency(&g_performance_frequency);
 
+  // The main thread draws tiles too, so one worker less than there are cores
+  SYSTEM_INFO system_info;
+  GetSystemInfo(&system_info);
+  int thread_count =
+      Min(Max((int)system_info.dwNumberOfProcessors, 1), kMaxThreadCount);
+
+  PlatformWorkQueue render_queue = {};
+  if (thread_count > 1) {
+    Win32MakeQueue(&render_queue, thread_count - 1);
+    g_render_queue = &render_queue;
+  }
+  g_render_settings.binned = true;
+  g_render_settings.thread_count = thread_count;
+  // Frames of a scene that hasn't changed are presented again as they are
+  g_render_settings.incremental = true;
+
   if (RegisterClass(&window_class)) {
     const int window_width = 1000;
     const int window_height = 1000;
@@ -186,66 +408,39 @@ int CALLBACK WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance,
                                hInstance, 0);
 
     // We're not going to release it as we use CS_OWNDC
-    HDC hdc = GetDC(window);
+    g_window_dc = GetDC(window);
 
     if (window) {
       g_running = true;
 
-      LARGE_INTEGER last_timestamp = Win32GetWallClock();
-
-      // Init backbuffer
-      {
-        g_game_backbuffer.max_width = 2000;
-        g_game_backbuffer.max_height = 1500;
-        g_game_backbuffer.bytes_per_pixel = 4;
-
-        int BufferSize = g_game_backbuffer.max_width *
-                         g_game_backbuffer.max_height *
-                         g_game_backbuffer.bytes_per_pixel;
-        // TODO: put it into the game_code memory?
-        g_game_backbuffer.memory =
-            VirtualAlloc(0, BufferSize, MEM_COMMIT, PAGE_READWRITE);
-
-        g_bitmap_info.bmiHeader.biSize = sizeof(g_bitmap_info.bmiHeader);
-        g_bitmap_info.bmiHeader.biPlanes = 1;
-        g_bitmap_info.bmiHeader.biBitCount = 32;
-        g_bitmap_info.bmiHeader.biCompression = BI_RGB;
-
-        // Set up proper values of buffers based on actual client size
-        Win32ResizeClientWindow(window);
+      // All the memory there will be, reserved upfront
+      GameMemory memory = {};
+      memory.permanent_storage_size = Megabytes(512);
+      memory.transient_storage_size = Megabytes(512);
+      u64 storage_size =
+          memory.permanent_storage_size + memory.transient_storage_size;
+      u8 *storage = (u8 *)VirtualAlloc(0, storage_size,
+                                       MEM_RESERVE | MEM_COMMIT,
+                                       PAGE_READWRITE);
+      memory.permanent_storage = storage;
+      memory.transient_storage = storage + memory.permanent_storage_size;
+      if (!storage || !InitializeRenderer(&memory)) {
+        OutputDebugStringA("Cannot reserve the memory\n");
+        return 1;
       }
 
-      // Main loop
+      // Set up the buffers based on the actual client size
+      StartFrameLoop(&g_frame_loop, &g_permanent_arena, 2000, 1500,
+                     target_fps, Win32PresentFrame, 0);
+      Win32ResizeClientWindow(window);
+
+      // Main loop, frame N is presented while N + 1 is drawn
       while (g_running) {
         Win32ProcessPendingMessages();
 
-        Render();
-
-        Win32UpdateWindow(hdc);
-
-        // Enforce FPS
-        // TODO: for some reason Time to sleep drops every now and again,
-        // disabling gradient solves or masks this, though I don't see
-        // any reason why this might happen
-        {
-          r32 MillisecondsElapsed =
-              Win32GetMsElapsed(last_timestamp, Win32GetWallClock());
-          u32 TimeToSleep = 0;
-
-          if (MillisecondsElapsed < target_mspf) {
-            TimeToSleep = (u32)(target_mspf - MillisecondsElapsed);
-            Sleep(TimeToSleep);
-
-            while (MillisecondsElapsed < target_mspf) {
-              MillisecondsElapsed =
-                  Win32GetMsElapsed(last_timestamp, Win32GetWallClock());
-            }
-          } else {
-            OutputDebugStringA("Frame missed\n");
-          }
-
-          last_timestamp = Win32GetWallClock();
-        }
+        GameOffscreenBuffer *buffer = BeginFrame(&g_frame_loop);
+        Render(buffer);
+        EndFrame(&g_frame_loop);
       }
     }
   } else {
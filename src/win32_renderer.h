@@ -1,8 +1,24 @@
 #ifndef WIN32_RENDERER_H
 #define WIN32_RENDERER_H
 
+struct PlatformWorkQueueEntry {
+  PlatformWorkQueueCallback *callback;
+  void *data;
+};
 
+struct PlatformWorkQueue {
+  u32 volatile completion_goal;
+  u32 volatile completion_count;
 
+  u32 volatile next_entry_to_write;
+  u32 volatile next_entry_to_read;
+  HANDLE semaphore_handle;
 
+  PlatformWorkQueueEntry entries[kPlatformWorkQueueSize];
+};
 
-#endif
\ No newline at end of file
+struct PlatformSemaphore {
+  HANDLE handle;
+};
+
+#endif